@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cmath>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QTextStream>
+
+#include "aimodel.h"
+#include "logicalmodel.h"
+#include "utils.h"
+
+// benchmark of the AI's turn search on saved positions (`.sav` files, as saved by the game, captured as slow positions, or made by hand)
+// each position is searched twice, looking for new sets among every group's free cards and then among the free cards indexed by rank & suit,
+// and the new set candidates looked at & the time taken are compared
+// or, with `--replay`, each position's turn is searched `--repeat` times over, each time from the same random number seed,
+// and the median (p50) & 95th percentile (p95) time, the search states created and the play found are reported
+// `--save-baseline` writes those to a file, one line of JSON per position, and `--baseline` compares them with such a file
+// `--no-order` searches rearrangements in the order made, rather than most promising first, to compare the two (at `--depth 2` or more, see `SearchSettings::orderRearrangements`)
+// usage: aibenchmark [--depth N] file.sav|directory ...
+//        aibenchmark --replay [--depth N] [--repeat N] [--no-order] [--baseline file.jsonl] [--save-baseline file.jsonl] file.sav|directory ...
+
+namespace
+{
+    const char *Usage = "usage: aibenchmark [--depth N] file.sav|directory ...\n"
+                        "       aibenchmark --replay [--depth N] [--repeat N] [--no-order] [--baseline file.jsonl] [--save-baseline file.jsonl] file.sav|directory ...";
+
+    struct BenchmarkResult
+    {
+        long newSetCandidates = 0;
+        qint64 elapsedNs = 0;
+        bool foundPlay = false;
+    };
+
+    bool loadPosition(const QString &filePath, LogicalModel &logicalModel)
+    {
+        // as `MainWindow::deserializeFromJson()`, with every hand played by the AI
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return false;
+        const QJsonDocument doc(QJsonDocument::fromJson(file.readAll()));
+        if (!doc.isObject())
+            return false;
+        const QJsonObject &obj = doc.object();
+        const QJsonArray &arrHands(obj["hands"].toArray());
+        logicalModel.hands.totalHands = arrHands.count();
+        logicalModel.hands.aiPlayers.fill(true, arrHands.count());
+        logicalModel.activePlayer = obj["activePlayer"].toInt();
+        logicalModel.cardDeck.deserializeFromJson(obj["cardDeck"].toObject());
+        logicalModel.hands.deserializeFromJson(arrHands, logicalModel.cardDeck);
+        logicalModel.cardGroups.deserializeFromJson(obj["cardGroups"].toArray(), logicalModel.cardDeck);
+        logicalModel.startOfTurn();
+        return true;
+    }
+
+    BenchmarkResult runSearch(AiModel &aiModel, const LogicalModel &logicalModel, bool indexFreeCards)
+    {
+        AiModel::SearchSettings settings(aiModel.searchSettings());
+        settings.indexFreeCards = indexFreeCards;
+        aiModel.setSearchSettings(settings);
+
+        BenchmarkResult result;
+        QMetaObject::Connection connection = QObject::connect(&aiModel, &AiModel::makeTurnPlay, [&result](int, AiModelState turnPlay) { result.foundPlay = !turnPlay.isNull(); });
+        QElapsedTimer timer;
+        timer.start();
+        aiModel.makeTurn(LogicalModelSnapshot(logicalModel), 0);
+        result.elapsedNs = timer.nsecsElapsed();
+        QObject::disconnect(connection);
+        result.newSetCandidates = AiModel::statistics.newSetCandidates;
+        return result;
+    }
+
+    struct ReplayResult
+    {
+        QString fileName;
+        qint64 p50Ns = 0;
+        qint64 p95Ns = 0;
+        long statesCreated = 0;
+        bool foundPlay = false;
+        int cardsPlayed = 0;
+        QList<int> handLeft;    // the ids of the cards left in hand after the play, sorted, to tell one play from another
+    };
+
+    ReplayResult replaySearch(AiModel &aiModel, const LogicalModel &logicalModel, int repeat)
+    {
+        ReplayResult result;
+        AiModelState turnPlay;
+        QMetaObject::Connection connection = QObject::connect(&aiModel, &AiModel::makeTurnPlay, [&turnPlay](int, AiModelState play) { turnPlay = play; });
+        const LogicalModelSnapshot snapshot(logicalModel);
+        QList<qint64> elapsedNs;
+        for (int i = 0; i < repeat; i++)
+        {
+            // (the same seed each time, so each search makes the same choices, and makes the same play)
+            RandomNumber::random_generator().seed(1);
+            turnPlay = AiModelState();
+            QElapsedTimer timer;
+            timer.start();
+            aiModel.makeTurn(snapshot, 0);
+            elapsedNs.append(timer.nsecsElapsed());
+        }
+        QObject::disconnect(connection);
+
+        // the nearest-rank percentiles
+        std::sort(elapsedNs.begin(), elapsedNs.end());
+        result.p50Ns = elapsedNs.at(qMax(0, int(std::ceil(0.50 * repeat)) - 1));
+        result.p95Ns = elapsedNs.at(qMax(0, int(std::ceil(0.95 * repeat)) - 1));
+        result.statesCreated = AiModel::statistics.aiModelStatesCreated;
+        result.foundPlay = !turnPlay.isNull();
+        if (result.foundPlay)
+        {
+            result.cardsPlayed = logicalModel.hands.at(logicalModel.activePlayer).count() - turnPlay.aiHand.count();
+            for (const Card *card : turnPlay.aiHand)
+                result.handLeft.append(card->id);
+            std::sort(result.handLeft.begin(), result.handLeft.end());
+        }
+        return result;
+    }
+
+    QJsonObject replayResultToJson(const ReplayResult &result)
+    {
+        QJsonArray handLeft;
+        for (int id : result.handLeft)
+            handLeft.append(id);
+        QJsonObject obj;
+        obj["file"] = result.fileName;
+        obj["p50Us"] = result.p50Ns / 1000;
+        obj["p95Us"] = result.p95Ns / 1000;
+        obj["statesCreated"] = qint64(result.statesCreated);
+        obj["foundPlay"] = result.foundPlay;
+        obj["cardsPlayed"] = result.cardsPlayed;
+        obj["handLeft"] = handLeft;
+        return obj;
+    }
+
+    ReplayResult replayResultFromJson(const QJsonObject &obj)
+    {
+        ReplayResult result;
+        result.fileName = obj["file"].toString();
+        result.p50Ns = qint64(obj["p50Us"].toDouble()) * 1000;
+        result.p95Ns = qint64(obj["p95Us"].toDouble()) * 1000;
+        result.statesCreated = long(obj["statesCreated"].toDouble());
+        result.foundPlay = obj["foundPlay"].toBool();
+        result.cardsPlayed = obj["cardsPlayed"].toInt();
+        for (const auto &val : obj["handLeft"].toArray())
+            result.handLeft.append(val.toInt());
+        return result;
+    }
+
+    bool loadBaseline(const QString &filePath, QMap<QString, ReplayResult> &baseline)
+    {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return false;
+        for (const QByteArray &line : file.readAll().split('\n'))
+        {
+            const QJsonDocument doc(QJsonDocument::fromJson(line));
+            if (doc.isObject())
+            {
+                const ReplayResult result(replayResultFromJson(doc.object()));
+                baseline[result.fileName] = result;
+            }
+        }
+        return true;
+    }
+
+    int replay(const QStringList &filePaths, int depth, int repeat, bool orderRearrangements, const QString &baselinePath, const QString &saveBaselinePath)
+    {
+        QTextStream out(stdout);
+        QMap<QString, ReplayResult> baseline;
+        if (!baselinePath.isEmpty() && !loadBaseline(baselinePath, baseline))
+        {
+            out << baselinePath << ": cannot load baseline" << Qt::endl;
+            return 1;
+        }
+        QFile saveBaselineFile(saveBaselinePath);
+        if (!saveBaselinePath.isEmpty() && !saveBaselineFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            out << saveBaselinePath << ": " << saveBaselineFile.errorString() << Qt::endl;
+            return 1;
+        }
+
+        LogicalModel logicalModel;
+        logicalModel.cardDeck.createCards();
+        AiModel aiModel;
+        aiModel.setDebugLevel(0);
+        AiModel::SearchSettings settings(aiModel.searchSettings());
+        settings.maxRearrangeDepth = depth;
+        settings.orderRearrangements = orderRearrangements;
+        aiModel.setSearchSettings(settings);
+
+        int positions = 0, compared = 0, differentPlays = 0, differentStates = 0;
+        qint64 p50TotalNs = 0;
+        double logP50RatioTotal = 0;
+        for (const QString &filePath : filePaths)
+        {
+            if (!loadPosition(filePath, logicalModel))
+            {
+                out << filePath << ": cannot load position" << Qt::endl;
+                continue;
+            }
+            ReplayResult result(replaySearch(aiModel, logicalModel, repeat));
+            result.fileName = QFileInfo(filePath).fileName();
+            positions++;
+            p50TotalNs += result.p50Ns;
+            if (saveBaselineFile.isOpen())
+                saveBaselineFile.write(QJsonDocument(replayResultToJson(result)).toJson(QJsonDocument::Compact) + '\n');
+
+            out << result.fileName
+                << "  p50 ms " << QString::number(result.p50Ns / 1e6, 'f', 3) << "  p95 ms " << QString::number(result.p95Ns / 1e6, 'f', 3)
+                << "  states " << result.statesCreated
+                << (result.foundPlay ? QString("  play found, cards played %1").arg(result.cardsPlayed) : QString("  no play"));
+            if (baseline.contains(result.fileName))
+            {
+                // (time is compared as a ratio, states & plays must be exactly the same)
+                const ReplayResult &base(baseline[result.fileName]);
+                const double p50Ratio = double(qMax(qint64(1), result.p50Ns)) / qMax(qint64(1), base.p50Ns);
+                compared++;
+                logP50RatioTotal += std::log(p50Ratio);
+                out << "  p50 x" << QString::number(p50Ratio, 'f', 2);
+                if (result.statesCreated != base.statesCreated)
+                {
+                    differentStates++;
+                    out << "  (STATES WERE " << base.statesCreated << ")";
+                }
+                if (result.foundPlay != base.foundPlay || result.handLeft != base.handLeft)
+                {
+                    differentPlays++;
+                    out << "  (DIFFERENT PLAY)";
+                }
+            }
+            out << Qt::endl;
+        }
+
+        out << "positions " << positions << "  depth " << depth << "  repeat " << repeat << (orderRearrangements ? "" : "  no order")
+            << "  p50 ms total " << QString::number(p50TotalNs / 1e6, 'f', 3) << Qt::endl;
+        if (!baselinePath.isEmpty())
+        {
+            out << "compared with baseline " << compared;
+            if (compared != 0)
+                out << "  p50 x" << QString::number(std::exp(logP50RatioTotal / compared), 'f', 3) << " (geometric mean)";
+            out << "  states different " << differentStates << "  plays different " << differentPlays << Qt::endl;
+        }
+        return (differentPlays == 0) ? 0 : 2;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    int depth = 1, repeat = 10;
+    bool replayMode = false, orderRearrangements = true;
+    QString baselinePath, saveBaselinePath;
+    QStringList filePaths;
+    const QStringList args(QCoreApplication::arguments().mid(1));
+    for (int i = 0; i < args.count(); i++)
+    {
+        if (args.at(i) == "--depth" && i + 1 < args.count())
+            depth = qBound(0, args.at(++i).toInt(), AiModel::MaxRearrangeDepth);
+        else if (args.at(i) == "--replay")
+            replayMode = true;
+        else if (args.at(i) == "--no-order")
+            orderRearrangements = false;
+        else if (args.at(i) == "--repeat" && i + 1 < args.count())
+            repeat = qMax(1, args.at(++i).toInt());
+        else if (args.at(i) == "--baseline" && i + 1 < args.count())
+            baselinePath = args.at(++i);
+        else if (args.at(i) == "--save-baseline" && i + 1 < args.count())
+            saveBaselinePath = args.at(++i);
+        else if (QFileInfo(args.at(i)).isDir())
+            for (const QFileInfo &fileInfo : QDir(args.at(i)).entryInfoList({ "*.sav" }, QDir::Files, QDir::Name))
+                filePaths.append(fileInfo.filePath());
+        else
+            filePaths.append(args.at(i));
+    }
+    if (filePaths.isEmpty() || (!replayMode && (!baselinePath.isEmpty() || !saveBaselinePath.isEmpty() || !orderRearrangements)))
+    {
+        out << Usage << Qt::endl;
+        return 1;
+    }
+    if (replayMode)
+        return replay(filePaths, depth, repeat, orderRearrangements, baselinePath, saveBaselinePath);
+
+    LogicalModel logicalModel;
+    logicalModel.cardDeck.createCards();
+    AiModel aiModel;
+    aiModel.setDebugLevel(0);
+    AiModel::SearchSettings settings(aiModel.searchSettings());
+    settings.maxRearrangeDepth = depth;
+    aiModel.setSearchSettings(settings);
+
+    BenchmarkResult scanTotal, indexTotal;
+    int positions = 0, differentPlays = 0;
+    for (const QString &filePath : filePaths)
+    {
+        if (!loadPosition(filePath, logicalModel))
+        {
+            out << filePath << ": cannot load position" << Qt::endl;
+            continue;
+        }
+        const BenchmarkResult scan(runSearch(aiModel, logicalModel, false));
+        const BenchmarkResult index(runSearch(aiModel, logicalModel, true));
+        positions++;
+        if (scan.foundPlay != index.foundPlay)
+            differentPlays++;
+        scanTotal.newSetCandidates += scan.newSetCandidates;
+        scanTotal.elapsedNs += scan.elapsedNs;
+        indexTotal.newSetCandidates += index.newSetCandidates;
+        indexTotal.elapsedNs += index.elapsedNs;
+
+        out << QFileInfo(filePath).fileName()
+            << "  scan: candidates " << scan.newSetCandidates << " ms " << QString::number(scan.elapsedNs / 1e6, 'f', 3)
+            << "  index: candidates " << index.newSetCandidates << " ms " << QString::number(index.elapsedNs / 1e6, 'f', 3)
+            << (index.foundPlay ? "  play found" : "  no play") << (scan.foundPlay != index.foundPlay ? "  (DIFFERENT)" : "") << Qt::endl;
+    }
+
+    out << "positions " << positions << "  depth " << depth << Qt::endl;
+    out << "scan:  candidates " << scanTotal.newSetCandidates << " ms " << QString::number(scanTotal.elapsedNs / 1e6, 'f', 3) << Qt::endl;
+    out << "index: candidates " << indexTotal.newSetCandidates << " ms " << QString::number(indexTotal.elapsedNs / 1e6, 'f', 3) << Qt::endl;
+    if (differentPlays != 0)
+        out << "plays found differently: " << differentPlays << Qt::endl;
+    return (differentPlays == 0) ? 0 : 2;
+}
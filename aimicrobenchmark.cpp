@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <random>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include "aimodel.h"
+#include "logicalmodel.h"
+#include "utils.h"
+
+// microbenchmarks of the set logic and of the pieces of the AI's turn search, each timed on its own
+// the positions are made by seeded self-play (as `selfplay` plays), and the groups & sets from them by a seeded generator,
+// so the same options always give the same positions, and one build can be compared with another on numbers
+// each benchmark reports the time, the heap allocations & frees and the search states (`AiSearchState`s made) per operation
+// (with glibc only: an allocation is any call of `malloc()`, `calloc()`, `realloc()`, `memalign()`, `aligned_alloc()` or `posix_memalign()`,
+// a free any call of `free()` with a block; `valloc()` & `pvalloc()` are not counted, nor is memory got without them, as by `mmap()`)
+// (build it in release: in debug every change to a `CardGroup` also remakes its debug string)
+// usage: aimicrobenchmark [--deals N] [--players N] [--seed N] [--min-ms N] [name ...]
+// given names, only the benchmarks whose names contain one of them are run
+
+namespace
+{
+    const char *Usage = "usage: aimicrobenchmark [--deals N] [--players N] [--seed N] [--min-ms N] [name ...]\n"
+                        "(with glibc, allocs/op counts malloc, calloc, realloc, memalign, aligned_alloc & posix_memalign calls, frees/op free calls; not valloc or pvalloc)";
+
+    std::atomic<long> s_heapAllocations(0);
+    std::atomic<long> s_heapFrees(0);
+    // (what each operation computes is added to this, so that the compiler cannot leave the operation out)
+    volatile long s_sink = 0;
+}
+
+#if defined(__GLIBC__)
+// every heap allocation & free is counted by standing in for glibc's `malloc()` & co., as Qt's containers call `malloc()` themselves, not `operator new`
+// (libstdc++'s `operator new` & `delete` call `malloc()` & `free()` through the PLT, so they are counted too)
+#define AIMICROBENCHMARK_HEAP_COUNTED
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *data, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *data);
+
+    void *malloc(size_t size) noexcept
+    {
+        s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+    void *calloc(size_t count, size_t size) noexcept
+    {
+        s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+    void *realloc(void *data, size_t size) noexcept
+    {
+        s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(data, size);
+    }
+    void *memalign(size_t alignment, size_t size) noexcept
+    {
+        s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_memalign(alignment, size);
+    }
+    void *aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return __libc_memalign(alignment, size);
+    }
+    int posix_memalign(void **data, size_t alignment, size_t size) noexcept
+    {
+        // (as glibc's own: the alignment must be a power of 2 & a multiple of a pointer's size, and `*data` is only set on success)
+        s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+            return EINVAL;
+        void *aligned = __libc_memalign(alignment, size);
+        if (aligned == nullptr)
+            return ENOMEM;
+        *data = aligned;
+        return 0;
+    }
+    void free(void *data) noexcept
+    {
+        if (data != nullptr)
+            s_heapFrees.fetch_add(1, std::memory_order_relaxed);
+        __libc_free(data);
+    }
+}
+#endif
+
+class AiModelMicrobenchmark
+{
+    // runs the pieces of `AiModel`'s search one at a time, on a position set up as `AiModel::findOneTurnPlay()` sets it up
+public:
+    typedef void (AiModel::*Generator)(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    struct NamedGenerator
+    {
+        const char *name;
+        Generator generator;
+    };
+
+    explicit AiModelMicrobenchmark(AiModel &aiModel) : _aiModel(aiModel) { _state.undoLog = &_undoLog; }
+
+    static QList<NamedGenerator> generators()
+    {
+        return {
+            { "AiModel::findAllCompleteRankSetsInHand", &AiModel::findAllCompleteRankSetsInHand },
+            { "AiModel::findAllCompleteRunSetsInHand", &AiModel::findAllCompleteRunSetsInHand },
+            { "AiModel::findAllCompleteRankSetsFrom2CardsInHand", &AiModel::findAllCompleteRankSetsFrom2CardsInHand },
+            { "AiModel::findAllCompleteRunSetsFrom2CardsInHand", &AiModel::findAllCompleteRunSetsFrom2CardsInHand },
+            { "AiModel::findAllAddToSetsFrom1CardInHand", &AiModel::findAllAddToSetsFrom1CardInHand },
+            { "AiModel::findAllMakeNewSetsFrom1CardInHand", &AiModel::findAllMakeNewSetsFrom1CardInHand },
+        };
+    }
+
+    void setPosition(const LogicalModelSnapshot &snapshot)
+    {
+        _aiModel._snapshot = snapshot;
+        _aiModel._turnNumber = 1;
+        _state = _aiModel.beginSearch();
+    }
+
+    long runGenerator(Generator generator)
+    {
+        // every turn play the generator finds is collected (so it never stops at the first), and the count of them returned
+        AiSearchArena::Scope scope;
+        AiSearchStates collected;
+        AiTurnPlayChooser turnPlays(false, &collected);
+        (_aiModel.*generator)(_state, turnPlays);
+        return turnPlays.count();
+    }
+
+    long findAllSimpleTurnPlays()
+    {
+        AiSearchArena::Scope scope;
+        AiSearchStates turnPlays;
+        _aiModel.findAllSimpleTurnPlays(_state, turnPlays);
+        return turnPlays.count();
+    }
+
+    long findAllPartialSetsFrom2CardsInHand()
+    {
+        AiSearchArena::Scope scope;
+        return _aiModel.findAllPartialRankSetsFrom2CardsInHand(_state).count() + _aiModel.findAllPartialRunSetsFrom2CardsInHand(_state).count();
+    }
+
+    long findAllFreeCardsInGroups() const
+    {
+        return _aiModel.findAllFreeCardsInGroups(_state).count();
+    }
+
+    long pivotSets(const CardMask sets[3]) const
+    {
+        AiSearchArena::Scope scope;
+        AiArenaList<CardMask> existingSets({ sets[0], sets[1], sets[2] });
+        return _aiModel.pivotSets(existingSets).count();
+    }
+
+    bool findOneTurnPlay()
+    {
+        bool found = !_aiModel.findOneTurnPlay().isNull();
+        // (as `AiModel::makeTurn()` does, once the turn has been searched)
+        AiSearchArena::current().reset();
+        return found;
+    }
+
+private:
+    AiModel &_aiModel;
+    AiSearchUndoLog _undoLog;
+    AiSearchState _state;
+};
+
+namespace
+{
+    struct Corpus
+    {
+        LogicalModel logicalModel;          // (owns the cards)
+        QList<LogicalModelSnapshot> positions;
+        QList<CardGroup> groups;            // each group of 3 or more on the baize, shuffled, and again with a card from hand added, so about half are good sets
+        QList<CardMask> groupMasks;         // the same, as masks
+        QList<QPair<int, int>> rankPairs;
+        QList<std::array<CardMask, 3>> pivotTriples;    // 3-card good sets on the same baize, taken 3 at a time
+    };
+
+    void makeCorpus(Corpus &corpus, int deals, int players, quint32 seed)
+    {
+        RandomNumber::random_generator().seed(seed);
+        LogicalModel &logicalModel(corpus.logicalModel);
+        logicalModel.cardDeck.createCards();
+        logicalModel.hands.totalHands = players;
+        logicalModel.hands.aiPlayers.fill(true, players);
+        AiModel aiModel;
+        aiModel.setDebugLevel(0);
+        AiModelState turnPlay;
+        QObject::connect(&aiModel, &AiModel::makeTurnPlay, [&turnPlay](int, AiModelState play) { turnPlay = play; });
+        int turnNumber = 0;
+        for (int deal = 0; deal < deals; deal++)
+        {
+            // as `selfplay` plays a deal
+            logicalModel.shuffleAndDeal();
+            logicalModel.activePlayer = 0;
+            logicalModel.hands.sortHands();
+            while (true)
+            {
+                logicalModel.startOfTurn();
+                corpus.positions.append(LogicalModelSnapshot(logicalModel));
+                turnPlay = AiModelState();
+                aiModel.makeTurn(corpus.positions.last(), ++turnNumber);
+                if (turnPlay.isNull())
+                    logicalModel.drawCardFromDrawPile();
+                else
+                    logicalModel.makePlays(turnPlay.cardGroups);
+                if (logicalModel.isDealOver(true))
+                    break;
+                logicalModel.endOfTurn();
+            }
+        }
+
+        std::mt19937 generator(seed);
+        for (const LogicalModelSnapshot &position : corpus.positions)
+        {
+            const CardHand &hand(position.hands().at(position.activePlayer()));
+            QList<CardMask> threeCardSets;
+            for (const CardGroup &group : position.cardGroups())
+            {
+                if (group.count() < 3)
+                    continue;
+                if (group.count() == 3 && group.isGoodSet())
+                    threeCardSets.append(CardMask(group));
+                QList<const Card *> cards(group);
+                for (int withHandCard = 0; withHandCard < 2; withHandCard++)
+                {
+                    if (withHandCard == 1)
+                    {
+                        if (hand.isEmpty())
+                            break;
+                        cards.append(hand.at(generator() % hand.count()));
+                    }
+                    std::shuffle(cards.begin(), cards.end(), generator);
+                    CardGroup candidate;
+                    candidate = cards;
+                    corpus.groups.append(candidate);
+                    corpus.groupMasks.append(CardMask(cards));
+                }
+            }
+            for (int i = 0; i < threeCardSets.count(); i++)
+                for (int j = i + 1; j < threeCardSets.count(); j++)
+                    for (int k = j + 1; k < threeCardSets.count(); k++)
+                        corpus.pivotTriples.append({ threeCardSets.at(i), threeCardSets.at(j), threeCardSets.at(k) });
+        }
+        for (int i = 0; i < 4096; i++)
+            corpus.rankPairs.append({ int(generator() % 13), int(generator() % 13) });
+    }
+
+    struct BenchmarkResult
+    {
+        long ops = 0;
+        qint64 elapsedNs = 0;
+        long heapAllocations = 0;
+        long heapFrees = 0;
+        long states = 0;
+    };
+
+    class Benchmarks
+    {
+    public:
+        Benchmarks(const QStringList &names, qint64 minNs) : _names(names), _minNs(minNs), _out(stdout) {}
+
+        bool wanted(const char *name) const
+        {
+            if (_names.isEmpty())
+                return true;
+            for (const QString &wantedName : _names)
+                if (QString(name).contains(wantedName))
+                    return true;
+            return false;
+        }
+
+        // time `op(i)` over all `count` items, pass after pass, until it has taken `_minNs` (after one pass to warm up)
+        template<typename Op>
+        void run(const char *name, int count, Op op)
+        {
+            if (!wanted(name) || count == 0)
+                return;
+            for (int i = 0; i < count; i++)
+                op(i);
+            BenchmarkResult result;
+            const long heapAllocations0 = s_heapAllocations.load(std::memory_order_relaxed), heapFrees0 = s_heapFrees.load(std::memory_order_relaxed);
+            const long states0 = AiModel::statistics.aiModelStatesCreated;
+            QElapsedTimer timer;
+            timer.start();
+            do
+            {
+                for (int i = 0; i < count; i++)
+                    op(i);
+                result.ops += count;
+            } while (timer.nsecsElapsed() < _minNs);
+            result.elapsedNs = timer.nsecsElapsed();
+            result.heapAllocations = s_heapAllocations.load(std::memory_order_relaxed) - heapAllocations0;
+            result.heapFrees = s_heapFrees.load(std::memory_order_relaxed) - heapFrees0;
+            result.states = AiModel::statistics.aiModelStatesCreated - states0;
+            report(name, result);
+        }
+
+        // as `run()`, but with `setUp(i)` before each item, not timed or counted, and `op(i)` then done `repeats` times on it
+        template<typename SetUp, typename Op>
+        void runWithSetUp(const char *name, int count, int repeats, SetUp setUp, Op op)
+        {
+            if (!wanted(name) || count == 0)
+                return;
+            for (int i = 0; i < count; i++)
+            {
+                setUp(i);
+                op(i);
+            }
+            BenchmarkResult result;
+            do
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    setUp(i);
+                    const long heapAllocations0 = s_heapAllocations.load(std::memory_order_relaxed), heapFrees0 = s_heapFrees.load(std::memory_order_relaxed);
+                    const long states0 = AiModel::statistics.aiModelStatesCreated;
+                    QElapsedTimer timer;
+                    timer.start();
+                    for (int repeat = 0; repeat < repeats; repeat++)
+                        op(i);
+                    result.elapsedNs += timer.nsecsElapsed();
+                    result.heapAllocations += s_heapAllocations.load(std::memory_order_relaxed) - heapAllocations0;
+                    result.heapFrees += s_heapFrees.load(std::memory_order_relaxed) - heapFrees0;
+                    result.states += AiModel::statistics.aiModelStatesCreated - states0;
+                }
+                result.ops += long(count) * repeats;
+            } while (result.elapsedNs < _minNs);
+            report(name, result);
+        }
+
+    private:
+        QStringList _names;
+        qint64 _minNs;
+        QTextStream _out;
+
+        void report(const char *name, const BenchmarkResult &result)
+        {
+            _out << QString(name).leftJustified(52)
+                 << QString::number(result.ops).rightJustified(10) << " ops"
+                 << QString::number(double(result.elapsedNs) / result.ops, 'f', 1).rightJustified(12) << " ns/op"
+#ifdef AIMICROBENCHMARK_HEAP_COUNTED
+                 << QString::number(double(result.heapAllocations) / result.ops, 'f', 2).rightJustified(10) << " allocs/op"
+                 << QString::number(double(result.heapFrees) / result.ops, 'f', 2).rightJustified(10) << " frees/op"
+#endif
+                 << QString::number(double(result.states) / result.ops, 'f', 2).rightJustified(10) << " states/op" << Qt::endl;
+        }
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    int deals = 10, players = 2, minMs = 200;
+    quint32 seed = 1;
+    QStringList names;
+    const QStringList args(QCoreApplication::arguments().mid(1));
+    for (int i = 0; i < args.count(); i++)
+    {
+        if (args.at(i).startsWith("--") && i + 1 >= args.count())
+        {
+            out << Usage << Qt::endl;
+            return 1;
+        }
+        if (args.at(i) == "--deals")
+            deals = qMax(1, args.at(++i).toInt());
+        else if (args.at(i) == "--players")
+            players = qBound(1, args.at(++i).toInt(), (104 - 4) / 13);
+        else if (args.at(i) == "--seed")
+            seed = args.at(++i).toUInt();
+        else if (args.at(i) == "--min-ms")
+            minMs = qMax(1, args.at(++i).toInt());
+        else if (args.at(i).startsWith("--"))
+        {
+            out << Usage << Qt::endl;
+            return 1;
+        }
+        else
+            names.append(args.at(i));
+    }
+
+    Corpus corpus;
+    makeCorpus(corpus, deals, players, seed);
+    out << "deals " << deals << "  players " << players << "  seed " << seed
+        << "  positions " << corpus.positions.count() << "  groups " << corpus.groups.count() << "  pivot triples " << corpus.pivotTriples.count() << Qt::endl;
+#ifndef AIMICROBENCHMARK_HEAP_COUNTED
+    out << "(heap allocations are only counted with glibc)" << Qt::endl;
+#endif
+
+    Benchmarks benchmarks(names, qint64(minMs) * 1000000);
+
+    // the set logic
+    // (a group keeps its classification until its cards change, so each operation assigns the cards afresh first)
+    CardGroup group;
+    benchmarks.run("CardGroup::rearrangeForSets", corpus.groups.count(), [&](int i) { group = corpus.groups.at(i); group.rearrangeForSets(); s_sink += group.count(); });
+    benchmarks.run("CardGroup::isGoodSet", corpus.groups.count(), [&](int i) { group = corpus.groups.at(i); s_sink += group.isGoodSet(); });
+    benchmarks.run("CardGroup::isGoodRankSet", corpus.groups.count(), [&](int i) { group = corpus.groups.at(i); s_sink += group.isGoodRankSet(); });
+    benchmarks.run("CardGroup::isGoodRunSet", corpus.groups.count(), [&](int i) { group = corpus.groups.at(i); s_sink += group.isGoodRunSet(); });
+    benchmarks.run("CardMask::isGoodSet", corpus.groupMasks.count(), [&](int i) { s_sink += corpus.groupMasks.at(i).isGoodSet(); });
+    benchmarks.run("CardMask::isGoodRankSet", corpus.groupMasks.count(), [&](int i) { s_sink += corpus.groupMasks.at(i).isGoodRankSet(); });
+    benchmarks.run("CardMask::isGoodRunSet", corpus.groupMasks.count(), [&](int i) { s_sink += corpus.groupMasks.at(i).isGoodRunSet(); });
+    benchmarks.run("CardGroup::rankDifference", corpus.rankPairs.count(), [&](int i) { s_sink += CardGroup::rankDifference(corpus.rankPairs.at(i).first, corpus.rankPairs.at(i).second); });
+
+    // the pieces of the search, each on every position, with the search settings' defaults
+    AiModel aiModel;
+    aiModel.setDebugLevel(0);
+    AiModelMicrobenchmark search(aiModel);
+    const int positionCount = corpus.positions.count();
+    auto setPosition = [&](int i) { search.setPosition(corpus.positions.at(i)); };
+    benchmarks.run("AiModel::pivotSets", corpus.pivotTriples.count(), [&](int i) { s_sink += search.pivotSets(corpus.pivotTriples.at(i).data()); });
+    benchmarks.runWithSetUp("AiModel::findAllFreeCardsInGroups", positionCount, 10, setPosition, [&](int) { s_sink += search.findAllFreeCardsInGroups(); });
+    benchmarks.runWithSetUp("AiModel::findAllPartialSetsFrom2CardsInHand", positionCount, 10, setPosition, [&](int) { s_sink += search.findAllPartialSetsFrom2CardsInHand(); });
+    for (const AiModelMicrobenchmark::NamedGenerator &generator : AiModelMicrobenchmark::generators())
+        benchmarks.runWithSetUp(generator.name, positionCount, 10, setPosition, [&](int) { s_sink += search.runGenerator(generator.generator); });
+    benchmarks.runWithSetUp("AiModel::findAllSimpleTurnPlays", positionCount, 10, setPosition, [&](int) { s_sink += search.findAllSimpleTurnPlays(); });
+    benchmarks.runWithSetUp("AiModel::findOneTurnPlay", positionCount, 1, setPosition, [&](int) { s_sink += search.findOneTurnPlay(); });
+    return 0;
+}
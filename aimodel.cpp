@@ -1,28 +1,266 @@
+#include <algorithm>
+#include <cstddef>
+#include <random>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSemaphore>
+#include <QThreadPool>
+
 #include "utils.h"
 #include "aimodel.h"
+#include "cardsetbatch.h"
 
 
 
-AiModel::Statistics AiModel::statistics;
+thread_local AiModel::Statistics AiModel::statistics;
 
 
 AiModelState::AiModelState()
 {
-    AiModel::statistics.aiModelStatesCreated++;
 }
 
 AiModelState::AiModelState(const CardHand &aiHand, const CardGroups &cardGroups)
     : aiHand(aiHand), cardGroups(cardGroups)
 {
+}
+
+
+
+AiSearchState::AiSearchState()
+{
+    groupCount = 0;
+    hash = 0;
+    undoLog = nullptr;
     AiModel::statistics.aiModelStatesCreated++;
 }
 
+AiSearchState::AiSearchState(const AiSearchState &other)
+    : aiHand(other.aiHand), groupCount(other.groupCount), hash(other.hash), undoLog(nullptr)
+{
+    // only copy the groups in use
+    std::copy(other.cardGroups, other.cardGroups + other.groupCount, cardGroups);
+    AiModel::statistics.aiModelStatesCreated++;
+}
+
+AiSearchState &AiSearchState::operator=(const AiSearchState &other)
+{
+    // (keeps its own undo log)
+    aiHand = other.aiHand;
+    groupCount = other.groupCount;
+    std::copy(other.cardGroups, other.cardGroups + other.groupCount, cardGroups);
+    hash = other.hash;
+    return *this;
+}
+
+AiSearchUndoLog::Mark AiSearchState::mark() const
+{
+    Q_ASSERT(undoLog != nullptr);
+    return { undoLog->changeCount(), groupCount, aiHand, hash };
+}
+
+void AiSearchState::undo(const AiSearchUndoLog::Mark &mark)
+{
+    // undo the changes made since `mark`, most recent first
+    Q_ASSERT(undoLog != nullptr);
+    while (undoLog->changeCount() > mark.changeCount)
+    {
+        AiSearchUndoLog::Change change(undoLog->takeLastChange());
+        cardGroups[change.index] = change.previousSet;
+    }
+    groupCount = mark.groupCount;
+    aiHand = mark.aiHand;
+    hash = mark.hash;
+}
+
+
+
+AiSearchArena::~AiSearchArena()
+{
+    for (const Block &block : _blocks)
+        delete[] block.data;
+}
+
+/*static*/ AiSearchArena &AiSearchArena::current()
+{
+    static thread_local AiSearchArena arena;
+    return arena;
+}
+
+void *AiSearchArena::allocate(size_t bytes, size_t alignment)
+{
+    // (block data is allocated by `new[]`, so aligned for any type)
+    Q_ASSERT(alignment <= alignof(std::max_align_t) && (alignment & (alignment - 1)) == 0);
+    size_t start = (_used + alignment - 1) & ~(alignment - 1);
+    if (_block < 0 || start + bytes > _blocks.at(_block).size)
+    {
+        nextBlock(bytes);
+        start = 0;
+    }
+    _inUse += start + bytes - _used;
+    _used = start + bytes;
+    AiModel::statistics.arenaAllocations++;
+    AiModel::statistics.arenaBytesAllocated += bytes;
+    if (long(_inUse) > AiModel::statistics.arenaPeakBytes)
+        AiModel::statistics.arenaPeakBytes = _inUse;
+    return _blocks.at(_block).data + start;
+}
+
+void AiSearchArena::deallocate(void *data, size_t bytes)
+{
+    // only the last allocation can be given back on its own (as when a container made in a loop goes out of scope)
+    if (_block >= 0 && static_cast<char *>(data) + bytes == _blocks.at(_block).data + _used)
+    {
+        size_t start = static_cast<char *>(data) - _blocks.at(_block).data;
+        _inUse -= _used - start;
+        _used = start;
+    }
+}
+
+void AiSearchArena::nextBlock(size_t bytes)
+{
+    // move on to the next block, counting what is left unused in this one as in use
+    // the next block is reused if there is one already (from before a rewind) big enough,
+    // else a new one replaces it (nothing in it is in use, everything after the rewind's mark was given back) or is added at the end
+    if (_block >= 0)
+        _inUse += _blocks.at(_block).size - _used;
+    _block++;
+    _used = 0;
+    if (_block < _blocks.count() && _blocks.at(_block).size >= bytes)
+        return;
+    size_t size = qMax(bytes, BlockSize);
+    if (_block < _blocks.count())
+    {
+        delete[] _blocks.at(_block).data;
+        _blocks[_block] = { new char[size], size };
+    }
+    else
+        _blocks.append({ new char[size], size });
+    AiModel::statistics.arenaBlocksAllocated++;
+}
+
+void AiSearchArena::reset()
+{
+    // give back everything, keeping only the first block for the next turn
+    rewind({ -1, 0, 0 });
+    while (_blocks.count() > 1)
+        delete[] _blocks.takeLast().data;
+}
+
+
+
+namespace
+{
+    class StrategyProfile
+    {
+        // profiles one call of a search strategy into `AiModel::statistics`, when profiling
+        // the profiles being made on a thread nest, so that each strategy's own time can be counted apart from that of the strategies it calls,
+        // and so that the states generated are counted to the innermost one
+        // (when not profiling nothing is counted, and the states generated cost only a check of `_innermost`)
+    public:
+        StrategyProfile(AiModel::Strategy strategy, int depth, bool profiling)
+            : _profiling(profiling), _strategy(strategy), _outer(_innermost), _innerNs(0)
+        {
+            if (!_profiling)
+                return;
+            AiModel::StrategyStatistics &strategyStatistics(AiModel::statistics.strategies[_strategy]);
+            strategyStatistics.calls++;
+            strategyStatistics.maxDepth = qMax(strategyStatistics.maxDepth, depth);
+            _innermost = this;
+            _timer.start();
+        }
+        ~StrategyProfile()
+        {
+            if (!_profiling)
+                return;
+            qint64 elapsedNs = _timer.nsecsElapsed();
+            AiModel::statistics.strategies[_strategy].elapsedNs += elapsedNs - _innerNs;
+            if (_outer != nullptr)
+                _outer->_innerNs += elapsedNs;
+            _innermost = _outer;
+        }
+        StrategyProfile(const StrategyProfile &) = delete;
+        StrategyProfile &operator=(const StrategyProfile &) = delete;
+
+        static void stateGenerated()
+        {
+            if (_innermost != nullptr)
+                AiModel::statistics.strategies[_innermost->_strategy].statesGenerated++;
+        }
+
+    private:
+        static thread_local StrategyProfile *_innermost;
+        bool _profiling;
+        AiModel::Strategy _strategy;
+        StrategyProfile *_outer;
+        qint64 _innerNs;
+        QElapsedTimer _timer;
+    };
+    thread_local StrategyProfile *StrategyProfile::_innermost = nullptr;
+}
+
+
+
+AiTurnPlayChooser::AiTurnPlayChooser(bool random, AiSearchStates *collected /*= nullptr*/)
+    : _random(random), _collected(collected), _count(0)
+{
+}
+
+void AiTurnPlayChooser::offer(const AiSearchState &turnPlay)
+{
+    // reservoir sampling: the n'th play offered replaces the one chosen so far with probability 1/n,
+    // which leaves each play equally likely to be the one chosen
+    Q_ASSERT(!isDone());
+    _count++;
+    StrategyProfile::stateGenerated();
+    if (_collected != nullptr)
+        _collected->append(turnPlay);
+    else if (_count == 1 || RandomNumber::random_int(_count - 1) == 0)
+        _chosen = turnPlay;
+}
+
+
+
+AiTranspositionTable::AiTranspositionTable()
+    : _hashes(1 << SizeBits)
+{
+}
+
+void AiTranspositionTable::clear()
+{
+    // only called between searches, when no other thread is using the table
+    for (QAtomicInteger<quint64> &hash : _hashes)
+        hash.storeRelaxed(0);
+}
+
 
 
 AiModel::AiModel(QObject *parent)
     : QObject{parent}
 {
     _debugLevel = 1;
+    _searchSettings.deterministic = true;
+    _searchSettings.maxThreads = 0;
+    _searchSettings.maxRearrangeDepth = 1;
+    _searchSettings.timeLimitMs = 0;
+    _searchSettings.nodeLimit = 0;
+    _searchSettings.orderRearrangements = true;
+    _searchSettings.randomTurnPlay = true;
+    _searchSettings.indexFreeCards = true;
+    _searchSettings.noPlayFilter = true;
+    _searchSettings.measureNoPlayFilter = false;
+    _searchSettings.collapseDuplicateCards = true;
+    _searchSettings.planTurn = false;
+    _searchSettings.planNodeLimit = 1000;
+    _searchSettings.profileStrategies = false;
+    _searchSettings.slowTurnMs = 0;
+    _searchSettings.slowTurnStates = 0;
+    _searchMaxDepth = 0;
+    _turnNumber = 0;
+    _cancelledTurnNumber.storeRelaxed(-1);
 }
 
 const CardHand &AiModel::aiHand() const
@@ -36,6 +274,23 @@ const CardHand &AiModel::aiHand() const
 void AiModel::resetStatistics()
 {
     statistics.isGoodSetCalls = statistics.aiModelStatesCreated = 0L;
+    statistics.transpositionTableHits = statistics.transpositionTableMisses = 0L;
+    statistics.setClassificationHits = statistics.setClassificationMisses = 0L;
+    statistics.groupClassificationHits = statistics.groupClassificationMisses = 0L;
+    statistics.newSetCandidates = 0L;
+    statistics.arenaAllocations = statistics.arenaBytesAllocated = statistics.arenaBlocksAllocated = statistics.arenaPeakBytes = 0L;
+    statistics.planNodesExpanded = statistics.planNodesPruned = 0L;
+    statistics.planCardsPlayed = 0;
+    statistics.noPlayFilterChecks = statistics.noPlayFilterHits = 0L;
+    statistics.noPlayFilterNs = statistics.noPlayFilterSavedNs = 0;
+    statistics.noPlayFilterSavedNodes = 0L;
+    statistics.searchNodes = statistics.searchNodesToSolution = 0L;
+    statistics.searchDepth = 0;
+    statistics.searchElapsedMs = 0;
+    statistics.searchTimeLimitHit = statistics.searchNodeLimitHit = false;
+    for (StrategyStatistics &strategyStatistics : statistics.strategies)
+        strategyStatistics = {};
+    statistics.chosenStrategy = statistics.chosenDepth = -1;
 }
 
 void AiModel::showStatistics()
@@ -44,97 +299,354 @@ void AiModel::showStatistics()
         return;
     qDebug() << __FUNCTION__
              << "isGoodSetCalls" << statistics.isGoodSetCalls
-             << "aiModelStatesCreated" << statistics.aiModelStatesCreated;
+             << "transpositionTableHits" << statistics.transpositionTableHits
+             << "transpositionTableMisses" << statistics.transpositionTableMisses
+             << "aiModelStatesCreated" << statistics.aiModelStatesCreated
+             << "setClassificationHits" << statistics.setClassificationHits
+             << "setClassificationMisses" << statistics.setClassificationMisses
+             << "groupClassificationHits" << statistics.groupClassificationHits
+             << "groupClassificationMisses" << statistics.groupClassificationMisses
+             << "newSetCandidates" << statistics.newSetCandidates;
+    qDebug() << __FUNCTION__
+             << "arenaAllocations" << statistics.arenaAllocations
+             << "arenaBytesAllocated" << statistics.arenaBytesAllocated
+             << "arenaBlocksAllocated" << statistics.arenaBlocksAllocated
+             << "arenaPeakBytes" << statistics.arenaPeakBytes;
+    qDebug() << __FUNCTION__
+             << "searchNodes" << statistics.searchNodes
+             << "searchNodesToSolution" << statistics.searchNodesToSolution
+             << "searchDepth" << statistics.searchDepth
+             << "searchElapsedMs" << statistics.searchElapsedMs;
+    if (statistics.noPlayFilterHits != 0)
+        qDebug() << __FUNCTION__ << "No play possible, search skipped, checked in" << statistics.noPlayFilterNs << "ns";
+    if (statistics.noPlayFilterHits != 0 && _searchSettings.measureNoPlayFilter)
+        qDebug() << __FUNCTION__ << "Search skipped would have taken" << statistics.noPlayFilterSavedNs << "ns," << statistics.noPlayFilterSavedNodes << "nodes";
+    if (statistics.searchTimeLimitHit)
+        qDebug() << __FUNCTION__ << "Search time limit hit:" << _searchSettings.timeLimitMs << "ms";
+    if (statistics.searchNodeLimitHit)
+        qDebug() << __FUNCTION__ << "Search node limit hit:" << _searchSettings.nodeLimit << "nodes";
+    if (statistics.planNodesExpanded != 0)
+        qDebug() << __FUNCTION__
+                 << "planNodesExpanded" << statistics.planNodesExpanded
+                 << "planNodesPruned" << statistics.planNodesPruned
+                 << "planCardsPlayed" << statistics.planCardsPlayed;
+    if (statistics.chosenStrategy >= 0)
+        qDebug() << __FUNCTION__
+                 << "chosenStrategy" << strategyName(Strategy(statistics.chosenStrategy))
+                 << "chosenDepth" << statistics.chosenDepth;
+    if (_searchSettings.profileStrategies)
+        for (int strategy = 0; strategy < StrategyCount; strategy++)
+        {
+            const StrategyStatistics &strategyStatistics(statistics.strategies[strategy]);
+            if (strategyStatistics.calls == 0)
+                continue;
+            qDebug() << __FUNCTION__ << strategyName(Strategy(strategy))
+                     << "calls" << strategyStatistics.calls
+                     << "statesGenerated" << strategyStatistics.statesGenerated
+                     << "elapsedUs" << strategyStatistics.elapsedNs / 1000
+                     << "maxDepth" << strategyStatistics.maxDepth;
+        }
 }
 
+/*static*/ const char *AiModel::strategyName(Strategy strategy)
+{
+    static const char *const names[StrategyCount] =
+    {
+        "completeSetsInHand",
+        "completeSetsFrom2CardsInHand",
+        "addToCompleteSetsFrom1CardInHand",
+        "completeSetsFrom1CardInHand",
+        "freeCardMoves",
+        "joinSets",
+        "splitSets",
+        "rearrangeSets",
+        "planTurn",
+    };
+    Q_ASSERT(strategy >= 0 && strategy < StrategyCount);
+    return names[strategy];
+}
 
-QList<const Card *> AiModel::freeCardsInGroup(const CardGroup &group) const
+void AiModel::writeStrategyProfile(int turnNumber, bool turnCancelled) const
 {
-    QList<const Card *> freeCards;
-    if (logicalModel->isInitialCardGroup(group))
-        freeCards.append(group);
-    else
+    // append the turn's profile to the profile file, as one line of JSON, for feeding elsewhere
+    QJsonObject strategiesObj;
+    for (int strategy = 0; strategy < StrategyCount; strategy++)
+    {
+        const StrategyStatistics &strategyStatistics(statistics.strategies[strategy]);
+        QJsonObject strategyObj;
+        strategyObj["calls"] = qint64(strategyStatistics.calls);
+        strategyObj["statesGenerated"] = qint64(strategyStatistics.statesGenerated);
+        strategyObj["elapsedUs"] = strategyStatistics.elapsedNs / 1000;
+        strategyObj["maxDepth"] = strategyStatistics.maxDepth;
+        strategiesObj[strategyName(Strategy(strategy))] = strategyObj;
+    }
+    QJsonObject obj;
+    obj["turnNumber"] = turnNumber;
+    obj["activePlayer"] = activePlayer();
+    obj["cancelled"] = turnCancelled;
+    obj["groupClassificationHits"] = qint64(statistics.groupClassificationHits);
+    obj["groupClassificationMisses"] = qint64(statistics.groupClassificationMisses);
+    obj["noPlayFiltered"] = statistics.noPlayFilterHits != 0;
+    obj["noPlayFilterUs"] = statistics.noPlayFilterNs / 1000;
+    if (_searchSettings.measureNoPlayFilter)
+    {
+        obj["noPlayFilterSavedUs"] = statistics.noPlayFilterSavedNs / 1000;
+        obj["noPlayFilterSavedNodes"] = qint64(statistics.noPlayFilterSavedNodes);
+    }
+    obj["searchNodes"] = qint64(statistics.searchNodes);
+    obj["searchDepth"] = statistics.searchDepth;
+    obj["searchElapsedMs"] = statistics.searchElapsedMs;
+    obj["chosenStrategy"] = (statistics.chosenStrategy >= 0) ? QJsonValue(strategyName(Strategy(statistics.chosenStrategy))) : QJsonValue();
+    obj["chosenDepth"] = statistics.chosenDepth;
+    obj["strategies"] = strategiesObj;
+
+    QFile file(_searchSettings.profileFilePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    {
+        qDebug() << __FUNCTION__ << "Cannot write profile file:" << _searchSettings.profileFilePath << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact) + '\n');
+}
+
+void AiModel::writeSlowPosition(int turnNumber, qint64 elapsedNs) const
+{
+    // write the position as a `.sav` file (which loads as any other), with what the turn took & the search settings it took it with
+    // the file is named by the hash of the position, so the same position is only kept once
+    QJsonObject statisticsObj;
+    statisticsObj["turnNumber"] = turnNumber;
+    statisticsObj["elapsedUs"] = elapsedNs / 1000;
+    statisticsObj["aiModelStatesCreated"] = qint64(statistics.aiModelStatesCreated);
+    statisticsObj["searchNodes"] = qint64(statistics.searchNodes);
+    statisticsObj["searchDepth"] = statistics.searchDepth;
+    statisticsObj["searchTimeLimitHit"] = statistics.searchTimeLimitHit;
+    statisticsObj["searchNodeLimitHit"] = statistics.searchNodeLimitHit;
+    statisticsObj["noPlayFiltered"] = statistics.noPlayFilterHits != 0;
+    QJsonObject settingsObj;
+    settingsObj["deterministic"] = _searchSettings.deterministic;
+    settingsObj["maxRearrangeDepth"] = _searchSettings.maxRearrangeDepth;
+    settingsObj["timeLimitMs"] = _searchSettings.timeLimitMs;
+    settingsObj["nodeLimit"] = _searchSettings.nodeLimit;
+    settingsObj["planTurn"] = _searchSettings.planTurn;
+    statisticsObj["searchSettings"] = settingsObj;
+
+    const QJsonDocument positionDoc(_snapshot.serializeToJson());
+    QJsonObject obj(positionDoc.object());
+    obj["aiStatistics"] = statisticsObj;
+
+    // (by a digest of the position, not `qHash()`, which is seeded differently in each process, so that the name is the same from run to run)
+    const QByteArray digest(QCryptographicHash::hash(positionDoc.toJson(QJsonDocument::Compact), QCryptographicHash::Sha1));
+    const QString fileName(QString("slow-%1.sav").arg(QString::fromLatin1(digest.toHex().left(16))));
+    QDir dir(_searchSettings.slowPositionsPath);
+    QFile file(dir.filePath(fileName));
+    if (!dir.mkpath(".") || !file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
     {
-        CardGroup::SetType setType;
-        statistics.isGoodSetCalls++;
-        if (group.isGoodSet(setType))
-            if (group.count() > 3)
+        qDebug() << __FUNCTION__ << "Cannot write slow position:" << dir.filePath(fileName) << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(obj).toJson());
+    if (debugLevel() >= 1)
+        qDebug() << __FUNCTION__ << "Slow turn:" << turnNumber << elapsedNs / 1000000 << "ms," << statistics.aiModelStatesCreated << "states, written to" << file.fileName();
+}
+
+
+namespace
+{
+    struct ZobristKeys
+    {
+        // a random key for each card in hand, and for each card in a group
+        // and when collapsing duplicate cards, for each face in a group, and for each face & copy of it in hand (up to the 2 packs' copies)
+        static constexpr int Faces = 52;
+        quint64 handCards[CardMask::MaxCards];
+        quint64 groupCards[CardMask::MaxCards];
+        quint64 handFaces[Faces][2];
+        quint64 groupFaces[Faces];
+
+        ZobristKeys()
+        {
+            std::mt19937_64 generator(104);
+            for (int i = 0; i < CardMask::MaxCards; i++)
             {
-                if (setType == CardGroup::RankSet)
-                    freeCards.append(group);
-                else if (setType == CardGroup::RunSet)
-                    freeCards.append({group.first(), group.last()});
+                handCards[i] = generator();
+                groupCards[i] = generator();
             }
+            for (int face = 0; face < Faces; face++)
+            {
+                handFaces[face][0] = generator();
+                handFaces[face][1] = generator();
+                groupFaces[face] = generator();
+            }
+        }
+    };
+    const ZobristKeys zobristKeys;
+}
+
+quint64 AiModel::handCardHash(const CardMask &hand, int card) const
+{
+    // the key toggled in & out of the hash as `card` leaves (or joins) `hand`, which holds it
+    // when collapsing duplicate cards, the face's key for the last copy held, whichever copy `card` is,
+    // so that a hand hashes by how many copies of each face it holds
+    Q_ASSERT(hand.contains(card));
+    if (!_searchSettings.collapseDuplicateCards)
+        return zobristKeys.handCards[card];
+    int face = card % ZobristKeys::Faces;
+    int copies = hand.contains(face) + hand.contains(face + ZobristKeys::Faces);
+    return zobristKeys.handFaces[face][copies - 1];
+}
+
+quint64 AiModel::groupHash(const CardMask &group) const
+{
+    // the keys of the cards in a group are combined, then mixed (as per "splitmix64")
+    // so that the hashes of the groups can in turn be combined without losing which cards were in which group
+    // the hash does not depend on where the group is in the state, and an empty group hashes to 0
+    if (group.isEmpty())
+        return 0;
+    // (a group never holds both copies of a card, as no set does, so their faces' keys do not cancel out)
+    quint64 hash = 0;
+    for (int card : group)
+        hash ^= _searchSettings.collapseDuplicateCards ? zobristKeys.groupFaces[card % ZobristKeys::Faces] : zobristKeys.groupCards[card];
+    hash = (hash ^ (hash >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    hash = (hash ^ (hash >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    return hash ^ (hash >> 31);
+}
+
+quint64 AiModel::stateHash(const AiSearchState &state) const
+{
+    quint64 hash = 0;
+    CardMask hand(state.aiHand);
+    for (int card : state.aiHand)
+    {
+        hash ^= handCardHash(hand, card);
+        hand.remove(card);
     }
-    return freeCards;
+    for (int i = 0; i < state.groupCount; i++)
+        hash ^= groupHash(state.cardGroups[i]);
+    return hash;
 }
 
-QList<const Card *> AiModel::findAllFreeCardsInGroups(const CardGroups &groups) const
+
+bool AiModel::isInitialCardGroup(const CardMask &group) const
+{
+    return (group.count() == 1 && group.intersects(_initialFreeCards));
+}
+
+const AiSetClassifications::Classification &AiModel::classifySet(const CardMask &group) const
 {
-    QList<const Card *> freeCards;
-    for (const CardGroup &group : groups)
-        freeCards.append(freeCardsInGroup(group));
+    // classify a group as a set, and find its free cards (those which could be taken leaving it still a set)
+    // each thread remembers the groups it has classified, so an unchanged group is only classified once
+    static thread_local AiSetClassifications setClassifications;
+    const AiSetClassifications::Classification *found = setClassifications.find(group);
+    if (found != nullptr)
+    {
+        statistics.setClassificationHits++;
+        return *found;
+    }
+    statistics.setClassificationMisses++;
+
+    AiSetClassifications::Classification classification;
+    classification.group = group;
+    statistics.isGoodSetCalls++;
+    classification.isGoodSet = group.isGoodSet(classification.setType);
+    if (classification.isGoodSet && group.count() > 3)
+    {
+        if (classification.setType == CardGroup::RankSet)
+            classification.freeCards = group;
+        else if (classification.setType == CardGroup::RunSet)
+        {
+            int cards[CardMask::MaxCards];
+            int cardCount = group.arrangedCardIds(cards);
+            classification.freeCards.insert(cards[0]);
+            classification.freeCards.insert(cards[cardCount - 1]);
+        }
+    }
+    return setClassifications.insert(classification);
+}
+
+CardMask AiModel::freeCardsInGroup(const CardMask &group) const
+{
+    if (isInitialCardGroup(group))
+        return group;
+    return classifySet(group).freeCards;
+}
+
+CardMask AiModel::findAllFreeCardsInGroups(const AiSearchState &state) const
+{
+    CardMask freeCards;
+    for (int i = 0; i < state.groupCount; i++)
+        freeCards |= freeCardsInGroup(state.cardGroups[i]);
     return freeCards;
 }
 
+AiFreeCardIndex AiModel::indexFreeCardsInGroups(const AiSearchState &state) const
+{
+    AiFreeCardIndex index;
+    for (int i = 0; i < state.groupCount; i++)
+    {
+        CardMask freeCards(freeCardsInGroup(state.cardGroups[i]));
+        for (int card : freeCards)
+        {
+            index.freeCardsOfRank[Card::rankOf(card)].insert(card);
+            index.freeCardsOfSuit[Card::suitOf(card)].insert(card);
+            index.groupOfCard[card] = qint8(i);
+        }
+        index.freeCards |= freeCards;
+    }
+    return index;
+}
 
-void AiModel::removeFirstCardRankSet(CardHand &hand, CardGroup &rankSet) const
+
+void AiModel::removeFirstCardRankSet(CardMask &hand, CardMask &rankSet) const
 {
     // remove the first card in hand
     // find any (longest) rank set using that card
     // because the set is longest, the further cards used cannot lie in any other rank set
     // so remove those cards too
-    rankSet.clear();
+    rankSet = CardMask();
     if (hand.isEmpty())
         return;
-    rankSet.append(hand.takeAt(0));
+    int card0 = hand.first();
+    hand.remove(card0);
+    rankSet.insert(card0);
     // check for same rank (different suits)
-    const Card *card0 = rankSet.first();
-    QSet<int> suits{card0->suit()};
-    for (int i = 0; i < hand.count(); i++)
-    {
-        const Card *card = hand.at(i);
-        if (card->rank() == card0->rank() && !suits.contains(card->suit()))
+    int suits = 1 << Card::suitOf(card0);
+    for (int card : hand)
+        if (Card::rankOf(card) == Card::rankOf(card0) && (suits & (1 << Card::suitOf(card))) == 0)
         {
-            suits.insert(card->suit());
-            rankSet.append(hand.takeAt(i--));
+            suits |= 1 << Card::suitOf(card);
+            hand.remove(card);
+            rankSet.insert(card);
         }
-    }
 }
 
-void AiModel::removeFirstCardRunSet(CardHand &hand, CardGroup &runSet) const
+void AiModel::removeFirstCardRunSet(CardMask &hand, CardMask &runSet) const
 {
     // remove the first card in hand
     // find any (longest, sequential) run set using that card
     // because the set is longest, the further cards used cannot lie in any other run set
     // so remove those cards too
-    runSet.clear();
+    runSet = CardMask();
     if (hand.isEmpty())
         return;
-    runSet.append(hand.takeAt(0));
+    int card0 = hand.first();
+    hand.remove(card0);
+    runSet.insert(card0);
     // check for sequential cards in same suit
-    const Card *card0 = runSet.first(), *card1 = runSet.last();
-    for (int i = 0; i < hand.count(); i++)
+    int suit = Card::suitOf(card0), rankHigh = Card::rankOf(card0), rankLow = rankHigh;
+    while (runSet.count() < 13)
     {
-        const Card *card = hand.at(i);
-        if (card->suit() != card0->suit())
-            continue;
-        if (runSet.rankDifference(card->rank(), card0->rank()) == 1)
-        {
-            runSet.prepend(hand.takeAt(i));
-            card0 = runSet.first();
-            i = -1;
-        }
-        else if (runSet.rankDifference(card->rank(), card1->rank()) == -1)
-        {
-            runSet.append(hand.takeAt(i));
-            card1 = runSet.last();
-            i = -1;
-        }
+        int card = hand.findCard(suit, (rankHigh + 1) % 13);
+        if (card >= 0)
+            rankHigh = (rankHigh + 1) % 13;
+        else if ((card = hand.findCard(suit, (rankLow + 12) % 13)) >= 0)
+            rankLow = (rankLow + 12) % 13;
+        else
+            break;
+        hand.remove(card);
+        runSet.insert(card);
     }
 }
 
-void AiModel::removeFirstCardGenerateAll2CardPartialRunSets(CardHand &hand, CardGroups &runSets) const
+void AiModel::removeFirstCardGenerateAll2CardPartialRunSets(CardMask &hand, AiArenaList<CardMask> &runSets) const
 {
     // remove the first card in hand
     // find any 2-card partial run set using that card
@@ -144,661 +656,906 @@ void AiModel::removeFirstCardGenerateAll2CardPartialRunSets(CardHand &hand, Card
     runSets.clear();
     if (hand.isEmpty())
         return;
-    const Card *card0(hand.takeAt(0));
-    for (const Card *card1 : hand)
-        if (card1->suit() == card0->suit())
+    int card0 = hand.first();
+    hand.remove(card0);
+    for (int card1 : hand)
+        if (Card::suitOf(card1) == Card::suitOf(card0))
         {
-            CardGroup runSet;
-            runSet.append(card0);
-            int rankDifference = runSet.rankDifference(card0->rank(), card1->rank());
-            if (rankDifference >= 0)
-                runSet.append(card1);
-            else
-                runSet.prepend(card1);
+            int rankDifference = CardGroup::rankDifference(Card::rankOf(card0), Card::rankOf(card1));
             if (rankDifference != 0 && qAbs(rankDifference) <= 2)
+            {
+                CardMask runSet(CardMask::fromId(card0));
+                runSet.insert(card1);
                 runSets.append(runSet);
+            }
         }
 }
 
 
-CardGroups AiModel::pivotSets(CardGroups existingSets) const
+AiArenaList<CardMask> AiModel::pivotSets(const AiArenaList<CardMask> &existingSets) const
 {
     // "pivot" the card groups, so that we make new groups by combining each first card in each set
     // to make a new set, and same for the second, third... card in each set
     // this can be used to try making a group of run sets into ranks sets or vice versa
 
-    CardGroups newSets;
-    for (CardGroup &existingSet : existingSets)
+    AiArenaList<CardMask> newSets;
+    for (const CardMask &existingSet : existingSets)
     {
         Q_ASSERT(existingSet.count() == existingSets.first().count());
         // ensure consistently sorted so that we produce right "pairing"
-        std::sort(existingSet.begin(), existingSet.end(), Card::compareForSortBySuit);
-        for (int i = 0; i < existingSet.count(); i++)
+        int cards[CardMask::MaxCards];
+        int cardCount = 0;
+        for (int card : existingSet)
+            cards[cardCount++] = card;
+        std::sort(cards, cards + cardCount, Card::compareIdsForSortBySuit);
+        for (int i = 0; i < cardCount; i++)
         {
             if (newSets.count() < i + 1)
                 newSets.resize(i + 1);
-            newSets[i].append(existingSet.at(i));
+            newSets[i].insert(cards[i]);
         }
     }
     return newSets;
 }
 
 
-void AiModel::verifyChangedState(AiModelState initialState, AiModelState newState) const
+void AiModel::verifyChangedState(const AiSearchState &newState) const
 {
-    QList<const Card *> initialCards(initialState.aiHand);
-    QList<const Card *> newStateCards(newState.aiHand);
-    initialCards.append(initialState.cardGroups.allCards());
-    newStateCards.append(newState.cardGroups.allCards());
-    while (!initialCards.isEmpty())
+    // check the state still holds exactly the cards the search started with, each once
+#ifdef QT_DEBUG
+    CardMask newStateCards(newState.aiHand);
+    int newStateCardCount = newState.aiHand.count();
+    for (int i = 0; i < newState.groupCount; i++)
     {
-        if (!newStateCards.removeOne(initialCards.first()))
-            Q_ASSERT(false);
-        initialCards.removeFirst();
+        newStateCards |= newState.cardGroups[i];
+        newStateCardCount += newState.cardGroups[i].count();
     }
-    Q_ASSERT(initialCards.isEmpty());
-    Q_ASSERT(newStateCards.isEmpty());
+    Q_ASSERT(newStateCards == _searchCards);
+    Q_ASSERT(newStateCardCount == newStateCards.count());
+    Q_ASSERT(newState.hash == stateHash(newState));
+#else
+    Q_UNUSED(newState);
+#endif
 }
 
 
-void AiModel::addNewSet(AiModelState &state, const CardGroup &newSet) const
+void AiModel::addNewSet(AiSearchState &state, const CardMask &newSet) const
 {
-    int index = state.cardGroups.findCardGroupByUniqueId(newSet.uniqueId());
-    Q_ASSERT(index < 0);
-    state.cardGroups.append(newSet);
+    // (cannot overflow: the search starts from at most `MaxSearchGroups` groups, a play adds at most 1 group,
+    // each rearrangement at most 3 (`searchEquivalent3RearrangeSetsStates()`), and the planner checks for room before each further play)
+    Q_ASSERT(state.groupCount < AiSearchState::MaxGroups);
+    state.cardGroups[state.groupCount++] = newSet;
+    state.hash ^= groupHash(newSet);
 }
 
-void AiModel::modifySet(AiModelState &state, const CardGroup &modifiedSet) const
+void AiModel::modifySet(AiSearchState &state, int index, const CardMask &modifiedSet) const
 {
-    int index = state.cardGroups.findCardGroupByUniqueId(modifiedSet.uniqueId());
-    Q_ASSERT(index >= 0);
-    state.cardGroups.replace(index, modifiedSet);
+    Q_ASSERT(index >= 0 && index < state.groupCount);
+    if (state.undoLog != nullptr)
+        state.undoLog->recordChange(index, state.cardGroups[index]);
+    state.hash ^= groupHash(state.cardGroups[index]) ^ groupHash(modifiedSet);
+    state.cardGroups[index] = modifiedSet;
 }
 
-void AiModel::clearSet(AiModelState &state, const CardGroup &existingSet) const
+void AiModel::clearSet(AiSearchState &state, int index) const
 {
-    int index = state.cardGroups.findCardGroupByUniqueId(existingSet.uniqueId());
-    Q_ASSERT(index >= 0);
-    state.cardGroups[index].clear();
+    Q_ASSERT(index >= 0 && index < state.groupCount);
+    if (state.undoLog != nullptr)
+        state.undoLog->recordChange(index, state.cardGroups[index]);
+    state.hash ^= groupHash(state.cardGroups[index]);
+    state.cardGroups[index] = CardMask();
 }
 
 
-void AiModel::removeCardFromHand(AiModelState &state, const Card *card) const
+void AiModel::removeCardFromHand(AiSearchState &state, int card) const
 {
-    if (!state.aiHand.removeOne(card))
-        Q_ASSERT(false);
+    Q_ASSERT(state.aiHand.contains(card));
+    state.hash ^= handCardHash(state.aiHand, card);
+    state.aiHand.remove(card);
 }
 
-void AiModel::removeCardsFromHand(AiModelState &state, const QList<const Card *> &cards) const
+void AiModel::removeCardsFromHand(AiSearchState &state, const CardMask &cards) const
 {
-    for (const Card *card : cards)
+    for (int card : cards)
         removeCardFromHand(state, card);
 }
 
-void AiModel::removeCardFromGroups(AiModelState &state, const Card *card) const
+void AiModel::removeCardFromGroups(AiSearchState &state, int card) const
 {
-    int index = state.cardGroups.removeCardFromGroups(card);
-    Q_ASSERT(index >= 0);
+    for (int i = 0; i < state.groupCount; i++)
+        if (state.cardGroups[i].contains(card))
+        {
+            modifySet(state, i, state.cardGroups[i] - CardMask::fromId(card));
+            return;
+        }
+    Q_ASSERT(false);
 }
 
-void AiModel::removeCardsFromGroups(AiModelState &state, const QList<const Card *> &cards) const
+void AiModel::removeCardsFromGroups(AiSearchState &state, const CardMask &cards) const
 {
-    for (const Card *card : cards)
+    for (int card : cards)
         removeCardFromGroups(state, card);
 }
 
-void AiModel::removeCardsFromOneGroup(AiModelState &state, const QList<const Card *> &cards) const
+void AiModel::removeCardsFromOneGroup(AiSearchState &state, const CardMask &cards) const
 {
     if (cards.isEmpty())
         return;
-    int index = state.cardGroups.removeCardFromGroups(cards.at(0));
-    Q_ASSERT(index >= 0);
-    for (int i = 1; i < cards.count(); i++)
-        if (!state.cardGroups[index].removeOne(cards.at(i)))
-            Q_ASSERT(false);
+    for (int i = 0; i < state.groupCount; i++)
+        if (state.cardGroups[i].contains(cards.first()))
+        {
+            Q_ASSERT(state.cardGroups[i].contains(cards));
+            modifySet(state, i, state.cardGroups[i] - cards);
+            return;
+        }
+    Q_ASSERT(false);
 }
 
 
-AiModelStates AiModel::findAllCompleteRankSetsInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteRankSetsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    CardHand hand(initialState.aiHand);
+    CardMask hand(handCardsToTry(state.aiHand));
     while (!hand.isEmpty())
     {
-        CardGroup rankSet;
+        CardMask rankSet;
         removeFirstCardRankSet(hand, rankSet);
         if (rankSet.count() >= 3)
         {
-            AiModelState newState(initialState);
-            removeCardsFromHand(newState, rankSet);
-            addNewSet(newState, rankSet);
-            verifyChangedState(initialState, newState);
-            newStates.append(newState);
+            AiSearchUndoLog::Mark mark(state.mark());
+            removeCardsFromHand(state, rankSet);
+            addNewSet(state, rankSet);
+            verifyChangedState(state);
+            turnPlays.offer(state);
+            state.undo(mark);
+            if (turnPlays.isDone())
+                return;
         }
     }
-    return newStates;
 }
 
-AiModelStates AiModel::findAllCompleteRunSetsInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteRunSetsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    CardHand hand(initialState.aiHand);
+    CardMask hand(handCardsToTry(state.aiHand));
     while (!hand.isEmpty())
     {
-        CardGroup runSet;
+        CardMask runSet;
         removeFirstCardRunSet(hand, runSet);
         if (runSet.count() >= 3)
         {
-            AiModelState newState(initialState);
-            removeCardsFromHand(newState, runSet);
-            addNewSet(newState, runSet);
-            verifyChangedState(initialState, newState);
-            newStates.append(newState);
+            AiSearchUndoLog::Mark mark(state.mark());
+            removeCardsFromHand(state, runSet);
+            addNewSet(state, runSet);
+            verifyChangedState(state);
+            turnPlays.offer(state);
+            state.undo(mark);
+            if (turnPlays.isDone())
+                return;
         }
     }
-    return newStates;
 }
 
 
-AiModelStates AiModel::rearrangeBrokenSetOnBaizeToOtherSets(const AiModelState &initialState, const CardGroup &brokenSet) const
+void AiModel::rearrangeBrokenSetOnBaizeToOtherSets(AiSearchState &state, int brokenSetIndex, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
+    // move the (1 or 2) cards of a broken set onto other sets: all of them onto one set, or each onto a different set
+    // moving a card onto one set leaves the others as they were, so which sets each card could join on its own is worked out just once
+    // each layout is offered once (moving both cards onto the same set one at a time would only repeat moving them together),
+    // and no more than `MaxBrokenSetRearrangements` are offered
+    static_assert(AiSearchState::MaxGroups <= 64, "groups are held as bits of a quint64");
+    const CardMask brokenSet(state.cardGroups[brokenSetIndex]);
     Q_ASSERT(brokenSet.count() < 3);
-    Q_ASSERT(initialState.cardGroups.contains(brokenSet));
 
     if (brokenSet.isEmpty())
-        return {};
-
-    for (const CardGroup &existingSet : initialState.cardGroups)
+        return;
+    int brokenCards[2];
+    int brokenCount = 0;
+    for (int card : brokenSet)
+        brokenCards[brokenCount++] = card;
+
+    int offered = 0;
+    auto offerState = [&]() -> bool {
+        verifyChangedState(state);
+        turnPlays.offer(state);
+        offered++;
+        return turnPlays.isDone() || offered >= MaxBrokenSetRearrangements;
+    };
+    auto couldJoin = [](const CardMask &existingSet, int card) {
+        int existingCard0 = existingSet.first();
+        return Card::rankOf(existingCard0) == Card::rankOf(card) || Card::suitOf(existingCard0) == Card::suitOf(card);
+    };
+
+    quint64 joinableGroups[2] = { 0, 0 };
+    for (int i = 0; i < state.groupCount; i++)
     {
-        if (existingSet == brokenSet)
+        if (i == brokenSetIndex)
             continue;
+        const CardMask existingSet(state.cardGroups[i]);
         if (existingSet.isEmpty())
             continue;
-        if (existingSet.first()->rank() != brokenSet.first()->rank() && existingSet.first()->suit() != brokenSet.first()->suit())
-            continue;
 
-        CardGroup newSet1(existingSet);
-        newSet1.append(brokenSet);
-        newSet1.rearrangeForSets();
-        statistics.isGoodSetCalls++;
-        if (newSet1.isGoodRankSet())
+        // (the broken cards are unordered, so allow any set here, else the result would depend on which card was moved first)
+        if (couldJoin(existingSet, brokenCards[0]))
         {
-            AiModelState newState(initialState);
-            clearSet(newState, brokenSet);
-            modifySet(newState, newSet1);
-            verifyChangedState(initialState, newState);
-            newStates.append(newState);
-        }
-
-        if (brokenSet.count() > 1)
-        {
-            CardGroup newSet2(existingSet);
-            CardGroup brokenSet2(brokenSet);
-            newSet2.append(brokenSet2.takeFirst());
-            newSet2.rearrangeForSets();
+            CardMask newSet1(existingSet | brokenSet);
             statistics.isGoodSetCalls++;
-            if (newSet2.isGoodSet())
+            if (newSet1.isGoodSet())
             {
-                AiModelState newState2(initialState);
-                modifySet(newState2, brokenSet2);
-                modifySet(newState2, newSet2);
-                verifyChangedState(initialState, newState2);
-                // recurse!
-                AiModelStates newStates2 = rearrangeBrokenSetOnBaizeToOtherSets(newState2, brokenSet2);
-                newStates.append(newStates2);
+                AiSearchUndoLog::Mark mark(state.mark());
+                clearSet(state, brokenSetIndex);
+                modifySet(state, i, newSet1);
+                bool done = offerState();
+                state.undo(mark);
+                if (done)
+                    return;
             }
         }
+
+        if (brokenCount > 1)
+            for (int k = 0; k < 2; k++)
+            {
+                if (!couldJoin(existingSet, brokenCards[k]))
+                    continue;
+                CardMask newSet2(existingSet);
+                newSet2.insert(brokenCards[k]);
+                statistics.isGoodSetCalls++;
+                if (newSet2.isGoodSet())
+                    joinableGroups[k] |= Q_UINT64_C(1) << i;
+            }
     }
 
-    return newStates;
+    for (quint64 groups0 = joinableGroups[0]; groups0 != 0; groups0 &= groups0 - 1)
+    {
+        int i = qCountTrailingZeroBits(groups0);
+        for (quint64 groups1 = joinableGroups[1] & ~(Q_UINT64_C(1) << i); groups1 != 0; groups1 &= groups1 - 1)
+        {
+            int j = qCountTrailingZeroBits(groups1);
+            AiSearchUndoLog::Mark mark(state.mark());
+            clearSet(state, brokenSetIndex);
+            modifySet(state, i, state.cardGroups[i] | CardMask::fromId(brokenCards[0]));
+            modifySet(state, j, state.cardGroups[j] | CardMask::fromId(brokenCards[1]));
+            bool done = offerState();
+            state.undo(mark);
+            if (done)
+                return;
+        }
+    }
 }
 
-AiModelStates AiModel::completePartialRankSetFrom1CardOnBaizeWithRearrangement(const AiModelState &initialState) const
+void AiModel::completePartialRankSetFrom1CardOnBaizeWithRearrangement(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    const CardGroup &partialSet(initialState.cardGroups.last());
+    int partialSetIndex = state.groupCount - 1;
+    const CardMask partialSet(state.cardGroups[partialSetIndex]);
     Q_ASSERT(partialSet.count() == 2);
-    Q_ASSERT(partialSet.at(0)->rank() == partialSet.at(1)->rank());
-    Q_ASSERT(partialSet.at(0)->suit() != partialSet.at(1)->suit());
+    int partialCard0 = partialSet.first();
 
-    for (const CardGroup &existingSet1 : initialState.cardGroups)
+    for (int i = 0; i < partialSetIndex; i++)
     {
-        if (existingSet1 == partialSet)
-            continue;
+        const CardMask existingSet1(state.cardGroups[i]);
         if (existingSet1.count() != 3)
             continue;
-        for (const Card *card : existingSet1)
+        for (int card : existingSet1)
         {
-            if (card->rank() != partialSet.first()->rank())
+            if (Card::rankOf(card) != Card::rankOf(partialCard0))
                 continue;
-            CardGroup rankSet(partialSet);
-            rankSet.append(card);
+            CardMask rankSet(partialSet);
+            rankSet.insert(card);
             statistics.isGoodSetCalls++;
             if (rankSet.isGoodRankSet())
             {
-                CardGroup breakSet(existingSet1);
-                breakSet.removeOne(card);
-                AiModelState newState(initialState);
-                modifySet(newState, breakSet);
-                modifySet(newState, rankSet);
-                verifyChangedState(initialState, newState);
-                AiModelStates newStates2 = rearrangeBrokenSetOnBaizeToOtherSets(newState, breakSet);
-                newStates.append(newStates2);
+                CardMask breakSet(existingSet1);
+                breakSet.remove(card);
+                AiSearchUndoLog::Mark mark(state.mark());
+                modifySet(state, i, breakSet);
+                modifySet(state, partialSetIndex, rankSet);
+                verifyChangedState(state);
+                rearrangeBrokenSetOnBaizeToOtherSets(state, i, turnPlays);
+                state.undo(mark);
+                if (turnPlays.isDone())
+                    return;
             }
         }
     }
-
-    return newStates;
 }
 
-AiModelStates AiModel::completePartialRunSetFrom1CardOnBaizeWithRearrangement(const AiModelState &initialState) const
+void AiModel::completePartialRunSetFrom1CardOnBaizeWithRearrangement(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    const CardGroup &partialSet(initialState.cardGroups.last());
+    int partialSetIndex = state.groupCount - 1;
+    const CardMask partialSet(state.cardGroups[partialSetIndex]);
     Q_ASSERT(partialSet.count() == 2);
-    Q_ASSERT(partialSet.at(0)->suit() == partialSet.at(1)->suit());
-    int rankDifference = qAbs(partialSet.rankDifference(partialSet.at(0)->rank(), partialSet.at(1)->rank()));
-    Q_ASSERT(rankDifference > 0 && rankDifference <= 2);
+    int partialCard0 = partialSet.first();
 
-    for (const CardGroup &existingSet1 : initialState.cardGroups)
+    for (int i = 0; i < partialSetIndex; i++)
     {
-        if (existingSet1 == partialSet)
-            continue;
+        const CardMask existingSet1(state.cardGroups[i]);
         if (existingSet1.count() != 3)
             continue;
-        for (const Card *card : existingSet1)
+        for (int card : existingSet1)
         {
-            if (card->suit() != partialSet.first()->suit())
+            if (Card::suitOf(card) != Card::suitOf(partialCard0))
                 continue;
-            CardGroup runSet(partialSet);
-            runSet.append(card);
-            runSet.rearrangeForSets();
+            CardMask runSet(partialSet);
+            runSet.insert(card);
             statistics.isGoodSetCalls++;
             if (runSet.isGoodRunSet())
             {
-                CardGroup breakSet(existingSet1);
-                breakSet.removeOne(card);
-                AiModelState newState(initialState);
-                modifySet(newState, breakSet);
-                modifySet(newState, runSet);
-                verifyChangedState(initialState, newState);
-                AiModelStates newStates2 = rearrangeBrokenSetOnBaizeToOtherSets(newState, breakSet);
-                newStates.append(newStates2);
+                CardMask breakSet(existingSet1);
+                breakSet.remove(card);
+                AiSearchUndoLog::Mark mark(state.mark());
+                modifySet(state, i, breakSet);
+                modifySet(state, partialSetIndex, runSet);
+                verifyChangedState(state);
+                rearrangeBrokenSetOnBaizeToOtherSets(state, i, turnPlays);
+                state.undo(mark);
+                if (turnPlays.isDone())
+                    return;
             }
         }
     }
-
-    return newStates;
 }
 
 
-AiModelStates AiModel::findAllPartialRankSetsFrom2CardsInHand(const AiModelState &initialState) const
+AiArenaList<CardMask> AiModel::findAllPartialRankSetsFrom2CardsInHand(const AiSearchState &initialState) const
 {
-    AiModelStates newStates;
-    CardHand hand(initialState.aiHand);
+    AiArenaList<CardMask> partialSets;
+    CardMask hand(handCardsToTry(initialState.aiHand));
     while (!hand.isEmpty())
     {
-        CardGroup rankSet;
+        CardMask rankSet;
         removeFirstCardRankSet(hand, rankSet);
         if (rankSet.count() == 2)
-        {
-            AiModelState newState(initialState);
-            removeCardsFromHand(newState, rankSet);
-            addNewSet(newState, rankSet);
-            verifyChangedState(initialState, newState);
-            newStates.append(newState);
-        }
+            partialSets.append(rankSet);
     }
-    return newStates;
+    return partialSets;
 }
 
-AiModelStates AiModel::findAllPartialRunSetsFrom2CardsInHand(const AiModelState &initialState) const
+AiArenaList<CardMask> AiModel::findAllPartialRunSetsFrom2CardsInHand(const AiSearchState &initialState) const
 {
-    AiModelStates newStates;
-    CardHand hand(initialState.aiHand);
+    AiArenaList<CardMask> partialSets;
+    CardMask hand(handCardsToTry(initialState.aiHand));
     while (!hand.isEmpty())
     {
-        CardGroups firstCardRunSets;
+        AiArenaList<CardMask> firstCardRunSets;
         removeFirstCardGenerateAll2CardPartialRunSets(hand, firstCardRunSets);
-        for (const CardGroup &runSet : firstCardRunSets)
+        for (const CardMask &runSet : firstCardRunSets)
         {
             Q_ASSERT(runSet.count() == 2);
-            AiModelState newState(initialState);
-            removeCardsFromHand(newState, runSet);
-            addNewSet(newState, runSet);
-            verifyChangedState(initialState, newState);
-            newStates.append(newState);
+            partialSets.append(runSet);
         }
     }
-    return newStates;
+    return partialSets;
 }
 
-AiModelStates AiModel::completePartialRankSetFrom1CardOnBaize(const AiModelState &initialState) const
+void AiModel::completePartialRankSetFrom1CardOnBaize(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    const CardGroup &partialSet(initialState.cardGroups.last());
+    int partialSetIndex = state.groupCount - 1;
+    const CardMask partialSet(state.cardGroups[partialSetIndex]);
     Q_ASSERT(partialSet.count() == 2);
-    Q_ASSERT(partialSet.at(0)->rank() == partialSet.at(1)->rank());
-    Q_ASSERT(partialSet.at(0)->suit() != partialSet.at(1)->suit());
+    int partialCard0 = partialSet.first();
+
+    int partialCard1 = *++partialSet.begin();
 
-    QList<const Card *> freeCards = findAllFreeCardsInGroups(initialState.cardGroups);
-    for (const Card *freeCard : freeCards)
+    // (only a free card of the same rank can complete the partial set, so the candidates always fit in one batch)
+    CardSetBatch rankSets;
+    CardMask freeCards = findAllFreeCardsInGroups(state);
+    for (int freeCard : freeCards)
     {
         if (partialSet.contains(freeCard))
             continue;
-        if (freeCard->rank() == partialSet.at(0)->rank())
-        {
-            CardGroup rankSet(partialSet);
-            rankSet.append(freeCard);
-            statistics.isGoodSetCalls++;
-            if (rankSet.isGoodRankSet())
-            {
-                AiModelState newState(initialState);
-                removeCardFromGroups(newState, freeCard);
-                modifySet(newState, rankSet);
-                verifyChangedState(initialState, newState);
-                newStates.append(newState);
-            }
-        }
+        if (Card::rankOf(freeCard) == Card::rankOf(partialCard0))
+            rankSets.append(partialCard0, partialCard1, freeCard);
+    }
+    statistics.isGoodSetCalls += rankSets.count();
+    rankSets.validate();
+    for (quint64 goodRankSets = rankSets.goodRankSets(); goodRankSets != 0; goodRankSets &= goodRankSets - 1)
+    {
+        int freeCard = rankSets.cardId(qCountTrailingZeroBits(goodRankSets), 2);
+        CardMask rankSet(partialSet);
+        rankSet.insert(freeCard);
+        AiSearchUndoLog::Mark mark(state.mark());
+        removeCardFromGroups(state, freeCard);
+        modifySet(state, partialSetIndex, rankSet);
+        verifyChangedState(state);
+        turnPlays.offer(state);
+        state.undo(mark);
+        if (turnPlays.isDone())
+            return;
     }
-    return newStates;
 }
 
-AiModelStates AiModel::completePartialRunSetFrom1CardOnBaize(const AiModelState &initialState) const
+void AiModel::completePartialRunSetFrom1CardOnBaize(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    const CardGroup &partialSet(initialState.cardGroups.last());
+    int partialSetIndex = state.groupCount - 1;
+    const CardMask partialSet(state.cardGroups[partialSetIndex]);
     Q_ASSERT(partialSet.count() == 2);
-    Q_ASSERT(partialSet.at(0)->suit() == partialSet.at(1)->suit());
-    int rankDifference = qAbs(partialSet.rankDifference(partialSet.at(0)->rank(), partialSet.at(1)->rank()));
-    Q_ASSERT(rankDifference > 0 && rankDifference <= 2);
+    int partialCard0 = partialSet.first();
 
-    QList<const Card *> freeCards = findAllFreeCardsInGroups(initialState.cardGroups);
-    for (const Card *freeCard : freeCards)
+    int partialCard1 = *++partialSet.begin();
+
+    // (only a free card of the same suit can complete the partial set, so the candidates always fit in one batch)
+    CardSetBatch runSets;
+    CardMask freeCards = findAllFreeCardsInGroups(state);
+    for (int freeCard : freeCards)
     {
         if (partialSet.contains(freeCard))
             continue;
-        if (freeCard->suit() == partialSet.at(0)->suit())
-        {
-            CardGroup runSet(partialSet);
-            runSet.append(freeCard);
-            runSet.rearrangeForSets();
-            statistics.isGoodSetCalls++;
-            if (runSet.isGoodRunSet())
-            {
-                AiModelState newState(initialState);
-                removeCardFromGroups(newState, freeCard);
-                modifySet(newState, runSet);
-                verifyChangedState(initialState, newState);
-                newStates.append(newState);
-            }
-        }
+        if (Card::suitOf(freeCard) == Card::suitOf(partialCard0))
+            runSets.append(partialCard0, partialCard1, freeCard);
+    }
+    statistics.isGoodSetCalls += runSets.count();
+    runSets.validate();
+    for (quint64 goodRunSets = runSets.goodRunSets(); goodRunSets != 0; goodRunSets &= goodRunSets - 1)
+    {
+        int freeCard = runSets.cardId(qCountTrailingZeroBits(goodRunSets), 2);
+        CardMask runSet(partialSet);
+        runSet.insert(freeCard);
+        AiSearchUndoLog::Mark mark(state.mark());
+        removeCardFromGroups(state, freeCard);
+        modifySet(state, partialSetIndex, runSet);
+        verifyChangedState(state);
+        turnPlays.offer(state);
+        state.undo(mark);
+        if (turnPlays.isDone())
+            return;
     }
-    return newStates;
 }
 
-AiModelStates AiModel::findAllCompleteRankSetsFrom2CardsInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteRankSetsFrom2CardsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    AiModelStates rankPartialSetStates = findAllPartialRankSetsFrom2CardsInHand(initialState);
-    if (rankPartialSetStates.isEmpty())
-        return newStates;
-    for (const AiModelState &rankPartialSetState : rankPartialSetStates)
+    AiArenaList<CardMask> rankPartialSets = findAllPartialRankSetsFrom2CardsInHand(state);
+    if (rankPartialSets.isEmpty())
+        return;
+    // the partial set is put down from the hand as a new group in place in the working state, and taken back afterwards
+    int turnPlayCount = turnPlays.count();
+    for (const CardMask &rankPartialSet : rankPartialSets)
     {
-        AiModelStates completeSets = completePartialRankSetFrom1CardOnBaize(rankPartialSetState);
-        newStates.append(completeSets);
+        AiSearchUndoLog::Mark mark(state.mark());
+        removeCardsFromHand(state, rankPartialSet);
+        addNewSet(state, rankPartialSet);
+        completePartialRankSetFrom1CardOnBaize(state, turnPlays);
+        state.undo(mark);
+        if (turnPlays.isDone())
+            return;
     }
-    if (newStates.isEmpty())
-        for (const AiModelState &rankPartialSetState : rankPartialSetStates)
+    if (turnPlays.count() == turnPlayCount)
+        for (const CardMask &rankPartialSet : rankPartialSets)
         {
-            AiModelStates completeSets = completePartialRankSetFrom1CardOnBaizeWithRearrangement(rankPartialSetState);
-            newStates.append(completeSets);
+            AiSearchUndoLog::Mark mark(state.mark());
+            removeCardsFromHand(state, rankPartialSet);
+            addNewSet(state, rankPartialSet);
+            completePartialRankSetFrom1CardOnBaizeWithRearrangement(state, turnPlays);
+            state.undo(mark);
+            if (turnPlays.isDone())
+                return;
         }
-    return newStates;
 }
 
-AiModelStates AiModel::findAllCompleteRunSetsFrom2CardsInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteRunSetsFrom2CardsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    AiModelStates runPartialSetStates = findAllPartialRunSetsFrom2CardsInHand(initialState);
-    if (runPartialSetStates.isEmpty())
-        return newStates;
-    for (const AiModelState &runPartialSetState : runPartialSetStates)
+    AiArenaList<CardMask> runPartialSets = findAllPartialRunSetsFrom2CardsInHand(state);
+    if (runPartialSets.isEmpty())
+        return;
+    // the partial set is put down from the hand as a new group in place in the working state, and taken back afterwards
+    int turnPlayCount = turnPlays.count();
+    for (const CardMask &runPartialSet : runPartialSets)
     {
-        AiModelStates completeSets = completePartialRunSetFrom1CardOnBaize(runPartialSetState);
-        newStates.append(completeSets);
+        AiSearchUndoLog::Mark mark(state.mark());
+        removeCardsFromHand(state, runPartialSet);
+        addNewSet(state, runPartialSet);
+        completePartialRunSetFrom1CardOnBaize(state, turnPlays);
+        state.undo(mark);
+        if (turnPlays.isDone())
+            return;
     }
-    if (newStates.isEmpty())
-        for (const AiModelState &runPartialSetState : runPartialSetStates)
+    if (turnPlays.count() == turnPlayCount)
+        for (const CardMask &runPartialSet : runPartialSets)
         {
-            AiModelStates completeSets = completePartialRunSetFrom1CardOnBaizeWithRearrangement(runPartialSetState);
-            newStates.append(completeSets);
+            AiSearchUndoLog::Mark mark(state.mark());
+            removeCardsFromHand(state, runPartialSet);
+            addNewSet(state, runPartialSet);
+            completePartialRunSetFrom1CardOnBaizeWithRearrangement(state, turnPlays);
+            state.undo(mark);
+            if (turnPlays.isDone())
+                return;
         }
-    return newStates;
 }
 
 
-AiModelStates AiModel::findAllAddToSetsFrom1CardInHand(const AiModelState &initialState) const
+void AiModel::findAllAddToSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    CardHand hand(initialState.aiHand);
-    while (!hand.isEmpty())
+    for (int card : handCardsToTry(state.aiHand))
     {
-        const Card *card = hand.takeFirst();
-        for (const CardGroup &existingSet : initialState.cardGroups)
+        for (int i = 0; i < state.groupCount; i++)
         {
+            const CardMask existingSet(state.cardGroups[i]);
             if (existingSet.count() < 2)
                 continue;
-            if (existingSet.first()->rank() != card->rank() && existingSet.first()->suit() != card->suit())
+            int existingCard0 = existingSet.first();
+            if (Card::rankOf(existingCard0) != Card::rankOf(card) && Card::suitOf(existingCard0) != Card::suitOf(card))
                 continue;
-            CardGroup newSet(existingSet);
-            newSet.append(card);
-            newSet.rearrangeForSets();
+            CardMask newSet(existingSet);
+            newSet.insert(card);
             statistics.isGoodSetCalls++;
             if (newSet.isGoodSet())
             {
-                AiModelState newState(initialState);
-                removeCardFromHand(newState, card);
-                modifySet(newState, newSet);
-                verifyChangedState(initialState, newState);
-                newStates.append(newState);
+                AiSearchUndoLog::Mark mark(state.mark());
+                removeCardFromHand(state, card);
+                modifySet(state, i, newSet);
+                verifyChangedState(state);
+                turnPlays.offer(state);
+                state.undo(mark);
+                if (turnPlays.isDone())
+                    return;
             }
         }
     }
-    return newStates;
 }
 
 
-AiModelStates AiModel::findAllMakeNewSetsFrom1CardInHand(const AiModelState &initialState) const
+void AiModel::findAllMakeNewSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates newStates;
-    CardHand hand(initialState.aiHand);
-    while (!hand.isEmpty())
+    // a card in hand makes a new set with 2 free cards from 2 different groups
+    // or with the 2 cards at either end of a run set of 5 or more
+    // the candidates are gathered into a batch and checked all at once, then the good ones are offered in the order they were gathered
+    CardSetBatch newSets;
+    auto offerNewSets = [this, &state, &turnPlays, &newSets]() -> bool
+    {
+        statistics.isGoodSetCalls += newSets.count();
+        newSets.validate();
+        for (quint64 goodSets = newSets.goodSets(); goodSets != 0 && !turnPlays.isDone(); goodSets &= goodSets - 1)
+        {
+            int n = qCountTrailingZeroBits(goodSets);
+            int card0 = newSets.cardId(n, 0), card1 = newSets.cardId(n, 1), card2 = newSets.cardId(n, 2);
+            CardMask newSet(CardMask::fromId(card0));
+            newSet.insert(card1);
+            newSet.insert(card2);
+            Q_ASSERT(newSet.isGoodSet());
+            AiSearchUndoLog::Mark mark(state.mark());
+            removeCardFromHand(state, card0);
+            removeCardFromGroups(state, card1);
+            removeCardFromGroups(state, card2);
+            addNewSet(state, newSet);
+            verifyChangedState(state);
+            turnPlays.offer(state);
+            state.undo(mark);
+        }
+        newSets.clear();
+        return turnPlays.isDone();
+    };
+    auto appendNewSet = [&newSets, &offerNewSets](int card0, int card1, int card2) -> bool
+    {
+        statistics.newSetCandidates++;
+        newSets.append(card0, card1, card2);
+        return newSets.isFull() && offerNewSets();
+    };
+
+    const AiFreeCardIndex freeCardIndex(indexFreeCardsInGroups(state));
+    for (int card0 : handCardsToTry(state.aiHand))
     {
-        const Card *card0 = hand.takeFirst();
-        for (const CardGroup &existingSet1 : initialState.cardGroups)
+        for (int i = 0; i < state.groupCount; i++)
         {
-            if (existingSet1.count() > 1 && existingSet1.count() < 4)
+            const CardMask existingSet1(state.cardGroups[i]);
+            if (existingSet1.count() < 5)
                 continue;
-            CardGroup::SetType setType;
-            statistics.isGoodSetCalls++;
-            bool isGoodSet1 = existingSet1.isGoodSet(setType);
+            const AiSetClassifications::Classification &classification1(classifySet(existingSet1));
+            if (!classification1.isGoodSet)
+                continue;
+            Q_ASSERT(classification1.setType == CardGroup::RunSet);
+            int cards1[CardMask::MaxCards];
+            int cardCount1 = existingSet1.arrangedCardIds(cards1);
+            if (Card::suitOf(cards1[0]) == Card::suitOf(card0))
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    int card1 = (pass == 0) ? cards1[0] : cards1[cardCount1 - 1];
+                    int card2 = (pass == 0) ? cards1[1] : cards1[cardCount1 - 2];
+                    CardMask newSet(CardMask::fromId(card0));
+                    newSet.insert(card1);
+                    newSet.insert(card2);
+                    if (newSet.isGoodRunSet())
+                    {
+                        AiSearchUndoLog::Mark mark(state.mark());
+                        removeCardFromHand(state, card0);
+                        removeCardsFromOneGroup(state, newSet - CardMask::fromId(card0));
+                        addNewSet(state, newSet);
+                        verifyChangedState(state);
+                        turnPlays.offer(state);
+                        state.undo(mark);
+                        if (turnPlays.isDone())
+                            return;
+                    }
+                }
+        }
 
-            if (existingSet1.count() >= 5 && isGoodSet1)
+        if (_searchSettings.indexFreeCards)
+        {
+            // only free cards of the same rank & a different suit can make a rank set with `card0`,
+            // and only free cards of the same suit & a different rank can make a run set
+            // each pair is looked at once, the order the 2 cards are taken in makes no difference to the new set
+            int rank0 = Card::rankOf(card0), suit0 = Card::suitOf(card0);
+            const CardMask candidatesForSets[2] =
             {
-                Q_ASSERT(setType == CardGroup::RunSet);
-                if (existingSet1.at(0)->suit() == card0->suit())
-                    for (int pass = 0; pass < 2; pass++)
+                freeCardIndex.freeCardsOfRank[rank0] - freeCardIndex.freeCardsOfSuit[suit0],
+                freeCardIndex.freeCardsOfSuit[suit0] - freeCardIndex.freeCardsOfRank[rank0]
+            };
+            for (const CardMask &candidates : candidatesForSets)
+            {
+                CardMask candidates2(candidates);
+                for (int card1 : candidates)
+                {
+                    candidates2.remove(card1);
+                    for (int card2 : candidates2)
                     {
-                        const Card *card1 = (pass == 0) ? existingSet1.at(0) : existingSet1.at(existingSet1.count() - 1);
-                        const Card *card2 = (pass == 0) ? existingSet1.at(1) : existingSet1.at(existingSet1.count() - 2);
-                        CardGroup newSet = {card0, card1, card2};
-                        newSet.rearrangeForSets();
-                        if (newSet.isGoodRunSet())
-                        {
-                            AiModelState newState(initialState);
-                            removeCardFromHand(newState, card0);
-                            removeCardsFromOneGroup(newState, {card1, card2});
-                            addNewSet(newState, newSet);
-                            verifyChangedState(initialState, newState);
-                            newStates.append(newState);
-                        }
+                        if (freeCardIndex.groupOfCard[card2] == freeCardIndex.groupOfCard[card1])
+                            continue;
+                        if (appendNewSet(card0, card1, card2))
+                            return;
                     }
+                }
             }
+            if (offerNewSets())
+                return;
+            continue;
+        }
 
-            QList<const Card *> freeCards1(freeCardsInGroup(existingSet1));
-            for (const Card *card1 : freeCards1)
+        for (int i = 0; i < state.groupCount; i++)
+        {
+            CardMask freeCards1(freeCardsInGroup(state.cardGroups[i]));
+            for (int card1 : freeCards1)
             {
-                if (card1->rank() != card0->rank() && card1->suit() != card0->suit())
+                if (Card::rankOf(card1) != Card::rankOf(card0) && Card::suitOf(card1) != Card::suitOf(card0))
                     continue;
-                for (const CardGroup &existingSet2 : initialState.cardGroups)
+                for (int j = 0; j < state.groupCount; j++)
                 {
-                    if (existingSet2 == existingSet1)
+                    if (j == i)
                         continue;
-                    QList<const Card *> freeCards2(freeCardsInGroup(existingSet2));
-                    for (const Card *card2 : freeCards2)
+                    CardMask freeCards2(freeCardsInGroup(state.cardGroups[j]));
+                    for (int card2 : freeCards2)
                     {
-                        if (card2->rank() != card0->rank() && card2->suit() != card0->suit())
+                        if (Card::rankOf(card2) != Card::rankOf(card0) && Card::suitOf(card2) != Card::suitOf(card0))
                             continue;
-                        CardGroup newSet = {card0, card1, card2};
-                        newSet.rearrangeForSets();
-                        statistics.isGoodSetCalls++;
-                        if (newSet.isGoodSet())
-                        {
-                            AiModelState newState(initialState);
-                            removeCardFromHand(newState, card0);
-                            removeCardFromGroups(newState, card1);
-                            removeCardFromGroups(newState, card2);
-                            addNewSet(newState, newSet);
-                            verifyChangedState(initialState, newState);
-                            newStates.append(newState);
-                        }
+                        if (appendNewSet(card0, card1, card2))
+                            return;
                     }
                 }
             }
         }
+        if (offerNewSets())
+            return;
     }
-    return newStates;
 }
 
 
-AiModelStates AiModel::findAllCompleteSetsInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteSetsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates completeSets;
-    AiModelStates rankSets = findAllCompleteRankSetsInHand(initialState);
-    AiModelStates runSets = findAllCompleteRunSetsInHand(initialState);
-    completeSets.append(rankSets);
-    completeSets.append(runSets);
-    if (debugLevel() >= (!completeSets.isEmpty() ? 2 : 3))
-        qDebug() << "        " << __FUNCTION__ << "Complete sets count:" << completeSets.count();
-    return completeSets;
+    findAllCompleteRankSetsInHand(state, turnPlays);
+    if (!turnPlays.isDone())
+        findAllCompleteRunSetsInHand(state, turnPlays);
+    if (debugLevel() >= (!turnPlays.isEmpty() ? 2 : 3))
+        qDebug() << "        " << __FUNCTION__ << "Complete sets count:" << turnPlays.count();
 }
 
-AiModelStates AiModel::findAllCompleteSetsFrom2CardsInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteSetsFrom2CardsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates completeSets;
-    AiModelStates rankSets = findAllCompleteRankSetsFrom2CardsInHand(initialState);
-    AiModelStates runSets = findAllCompleteRunSetsFrom2CardsInHand(initialState);
-    completeSets.append(rankSets);
-    completeSets.append(runSets);
-    if (debugLevel() >= (!completeSets.isEmpty() ? 2 : 3))
-        qDebug() << "        " << __FUNCTION__  << "Complete sets count:" << completeSets.count();
-    return completeSets;
+    findAllCompleteRankSetsFrom2CardsInHand(state, turnPlays);
+    if (!turnPlays.isDone())
+        findAllCompleteRunSetsFrom2CardsInHand(state, turnPlays);
+    if (debugLevel() >= (!turnPlays.isEmpty() ? 2 : 3))
+        qDebug() << "        " << __FUNCTION__  << "Complete sets count:" << turnPlays.count();
 }
 
-AiModelStates AiModel::findAllAddToCompleteSetsFrom1CardInHand(const AiModelState &initialState) const
+void AiModel::findAllAddToCompleteSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates completeSets = findAllAddToSetsFrom1CardInHand(initialState);
-    if (debugLevel() >= (!completeSets.isEmpty() ? 2 : 3))
-        qDebug() << "        " << __FUNCTION__ << "Complete sets count:" << completeSets.count();
-    return completeSets;
+    findAllAddToSetsFrom1CardInHand(state, turnPlays);
+    if (debugLevel() >= (!turnPlays.isEmpty() ? 2 : 3))
+        qDebug() << "        " << __FUNCTION__ << "Complete sets count:" << turnPlays.count();
 }
 
-AiModelStates AiModel::findAllCompleteSetsFrom1CardInHand(const AiModelState &initialState) const
+void AiModel::findAllCompleteSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const
 {
-    AiModelStates completeSets = findAllMakeNewSetsFrom1CardInHand(initialState);
-    if (debugLevel() >= (!completeSets.isEmpty() ? 2 : 3))
-        qDebug() << "        " << __FUNCTION__ << "Complete sets count:" << completeSets.count();
-    return completeSets;
+    findAllMakeNewSetsFrom1CardInHand(state, turnPlays);
+    if (debugLevel() >= (!turnPlays.isEmpty() ? 2 : 3))
+        qDebug() << "        " << __FUNCTION__ << "Complete sets count:" << turnPlays.count();
 }
 
 
-AiModelState AiModel::findOneSimpleTurnPlay(const AiModelState &initialState, int depth) const
+AiSearchState AiModel::findOneSimpleTurnPlay(AiSearchState &state, int depth) const
 {
-    AiModelStates turnPlays;
-    AiModelState turnPlay;
+    // each stage offers the turn plays it finds one at a time, and only the one chosen so far is kept
+    AiTurnPlayChooser turnPlays(_searchSettings.randomTurnPlay);
+    // each stage is one strategy, profiled when wanted, and noted as the one which found the play if it does
+    auto findAll = [&](Strategy strategy, void (AiModel::*findAllTurnPlays)(AiSearchState &, AiTurnPlayChooser &) const) -> bool {
+        {
+            StrategyProfile profile(strategy, depth, _searchSettings.profileStrategies);
+            (this->*findAllTurnPlays)(state, turnPlays);
+        }
+        if (turnPlays.isEmpty())
+            return false;
+        Q_ASSERT(!turnPlays.chosen().isNull());
+        statistics.chosenStrategy = strategy;
+        statistics.chosenDepth = depth;
+        return true;
+    };
+
+    // the simple stages on the position itself (depth 0) cost next to nothing, and their play is the best there is when the budget runs out,
+    // so they only stop for the turn being cancelled; the budget applies to the rearranged positions
+    auto stopSearching = [this, depth]() { return (depth == 0) ? turnCancelled() : searchCancelled(); };
 
     if (depth == 0)
     {
         // find all 3+ complete sets in hand, nothing from baize
-        turnPlays = findAllCompleteSetsInHand(initialState);
-        if (!turnPlays.isEmpty())
-        {
-            turnPlay = RandomNumber::random_element(turnPlays);
-            Q_ASSERT(!turnPlay.isNull());
-            return turnPlay;
-        }
+        if (findAll(CompleteSetsInHandStrategy, &AiModel::findAllCompleteSetsInHand))
+            return turnPlays.chosen();
     }
 
+    if (stopSearching())
+        return {};
+
     // find all 2+ partial sets in hand which can be completed from 1 free card on baize
-    turnPlays = findAllCompleteSetsFrom2CardsInHand(initialState);
-    if (!turnPlays.isEmpty())
-    {
-        turnPlay = RandomNumber::random_element(turnPlays);
-        Q_ASSERT(!turnPlay.isNull());
-        return turnPlay;
-    }
+    if (findAll(CompleteSetsFrom2CardsInHandStrategy, &AiModel::findAllCompleteSetsFrom2CardsInHand))
+        return turnPlays.chosen();
+
+    if (stopSearching())
+        return {};
 
     // find all 1 card in hand which can be added to existing sets on baize
-    turnPlays = findAllAddToCompleteSetsFrom1CardInHand(initialState);
-    if (!turnPlays.isEmpty())
-    {
-        turnPlay = RandomNumber::random_element(turnPlays);
-        Q_ASSERT(!turnPlay.isNull());
-        return turnPlay;
-    }
+    if (findAll(AddToCompleteSetsFrom1CardInHandStrategy, &AiModel::findAllAddToCompleteSetsFrom1CardInHand))
+        return turnPlays.chosen();
+
+    if (stopSearching())
+        return {};
 
     // find all 1 card in hand which can be completed from 2 free cards on baize
-    turnPlays = findAllCompleteSetsFrom1CardInHand(initialState);
-    if (!turnPlays.isEmpty())
+    if (findAll(CompleteSetsFrom1CardInHandStrategy, &AiModel::findAllCompleteSetsFrom1CardInHand))
+        return turnPlays.chosen();
+
+    return {};
+}
+
+
+bool AiModel::searchBudgetExhausted() const
+{
+    // whether the search has run past its time limit or searched its limit of rearranged states
+    // once exhausted it stays so until the next turn
+    if (_searchBudgetExhausted.loadRelaxed() != SearchBudgetLeft)
+        return true;
+    if (_searchSettings.nodeLimit > 0 && _searchNodes.loadRelaxed() >= _searchSettings.nodeLimit)
+        _searchBudgetExhausted.testAndSetRelaxed(SearchBudgetLeft, SearchNodeLimitHit);
+    else if (_searchSettings.timeLimitMs > 0 && _searchTimer.hasExpired(_searchSettings.timeLimitMs))
+        _searchBudgetExhausted.testAndSetRelaxed(SearchBudgetLeft, SearchTimeLimitHit);
+    return _searchBudgetExhausted.loadRelaxed() != SearchBudgetLeft;
+}
+
+AiSearchState AiModel::searchEquivalentState(AiSearchState &equivalentState, int depth) const
+{
+    // search again in a rearranged (equivalent) state, and if there are rearrangements left rearrange it further
+    // different rearrangements often arrive at the same state, so remember those which have been found to have no play
+    // (with as many rearrangements left)
+    if (searchCancelled())
+        return {};
+    int rearrangementsLeft = _searchMaxDepth - depth;
+    quint64 noPlayHash = equivalentState.hash + rearrangementsLeft * Q_UINT64_C(0x9E3779B97F4A7C15);
+    if (_noPlayStates.contains(noPlayHash))
     {
-        turnPlay = RandomNumber::random_element(turnPlays);
-        Q_ASSERT(!turnPlay.isNull());
-        return turnPlay;
+        statistics.transpositionTableHits++;
+        return {};
     }
+    statistics.transpositionTableMisses++;
+    _searchNodes.fetchAndAddRelaxed(1);
+
+    // the containers made while searching this state are all given back when it has been searched
+    AiSearchArena::Scope arenaScope;
+    AiSearchState turnPlay = findOneSimpleTurnPlay(equivalentState, depth);
+    if (turnPlay.isNull() && rearrangementsLeft > 0)
+        turnPlay = findOneComplexTurnPlay(equivalentState, depth);
+    // a search cancelled part way through has not shown that there is no play
+    if (turnPlay.isNull() && !searchCancelled())
+        _noPlayStates.insert(noPlayHash);
+    return turnPlay;
+}
 
-    return {};
+AiSearchState AiModel::searchEquivalentStatesInParallel(const AiSearchStates &equivalentStates, int depth) const
+{
+    // search the rearranged (equivalent) states on the thread pool
+    // the first play found wins, and the other threads are cancelled at their next check
+    QThreadPool *threadPool = QThreadPool::globalInstance();
+    int threadCount = _searchSettings.maxThreads > 0 ? _searchSettings.maxThreads : threadPool->maxThreadCount();
+    threadCount = qBound(1, threadCount, int(equivalentStates.count()));
+
+    QAtomicInt nextIndex(0);
+    QMutex mutex;
+    QSemaphore finished;
+    AiSearchState foundPlay;
+    int foundChosenStrategy = -1, foundChosenDepth = -1;
+    Statistics threadStatistics = {};
+    for (int thread = 0; thread < threadCount; thread++)
+        threadPool->start([&]() {
+            statistics = {};
+            AiSearchUndoLog undoLog;
+            while (!searchCancelled())
+            {
+                int index = nextIndex.fetchAndAddRelaxed(1);
+                if (index >= equivalentStates.count())
+                    break;
+                // each thread searches a copy of the state, changing it in place with its own undo log
+                AiSearchState workingState(equivalentStates.at(index));
+                workingState.undoLog = &undoLog;
+                AiSearchState turnPlay = searchEquivalentState(workingState, depth);
+                if (!turnPlay.isNull())
+                {
+                    QMutexLocker locker(&mutex);
+                    if (foundPlay.isNull())
+                    {
+                        foundPlay = turnPlay;
+                        foundChosenStrategy = statistics.chosenStrategy;
+                        foundChosenDepth = statistics.chosenDepth;
+                    }
+                    _searchCancelled.storeRelaxed(1);
+                }
+            }
+            {
+                QMutexLocker locker(&mutex);
+                threadStatistics += statistics;
+            }
+            // the pool's threads are shared, and outlive the turn, so give back their arena's blocks now, as `makeTurn()` does for its own thread
+            // (nothing the task allocated from it is left: the play found is copied out, and `AiSearchState`s do not use the arena)
+            AiSearchArena::current().reset();
+            finished.release();
+        });
+    finished.acquire(threadCount);
+
+    statistics += threadStatistics;
+    if (!foundPlay.isNull())
+    {
+        statistics.chosenStrategy = foundChosenStrategy;
+        statistics.chosenDepth = foundChosenDepth;
+    }
+    // the cancellation was only for this batch of states; the search carries on if none had a play
+    _searchCancelled.storeRelaxed(0);
+    return foundPlay;
 }
 
+AiSearchState AiModel::searchRearrangedState(AiSearchState &state, int depth, AiSearchStates *deferredStates) const
+{
+    // search a rearranged (equivalent) state, made in place in the working state
+    // or when the rearranged states are to be searched in parallel, keep a copy of it to be searched later
+    StrategyProfile::stateGenerated();
+    if (deferredStates != nullptr)
+    {
+        deferredStates->append(state);
+        return {};
+    }
+    return searchEquivalentState(state, depth);
+}
 
-AiModelState AiModel::searchEquivalent1FreeCardMoveStates(const AiModelState &initialState, int depth) const
+AiSearchState AiModel::searchEquivalent1FreeCardMoveStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const
 {
-    AiModelState turnPlay;
+    AiSearchState turnPlay;
+    StrategyProfile profile(FreeCardMovesStrategy, depth, _searchSettings.profileStrategies);
 
     // for each free card, move to each other (complete) set and search again
-    QList<const Card *> freeCards = findAllFreeCardsInGroups(initialState.cardGroups);
-    for (const Card *freeCard : freeCards)
-        for (const CardGroup &existingSet : initialState.cardGroups)
+    CardMask freeCards = findAllFreeCardsInGroups(state);
+    for (int freeCard : freeCards)
+        for (int i = 0; i < state.groupCount; i++)
         {
+            const CardMask existingSet(state.cardGroups[i]);
             if (existingSet.contains(freeCard))
                 continue;
             if (existingSet.count() < 2)
                 continue;
-            if (existingSet.first()->rank() != freeCard->rank() && existingSet.first()->suit() != freeCard->suit())
+            int existingCard0 = existingSet.first();
+            if (Card::rankOf(existingCard0) != Card::rankOf(freeCard) && Card::suitOf(existingCard0) != Card::suitOf(freeCard))
                 continue;
-            CardGroup newSet(existingSet);
-            newSet.append(freeCard);
-            newSet.rearrangeForSets();
+            CardMask newSet(existingSet);
+            newSet.insert(freeCard);
             statistics.isGoodSetCalls++;
             if (newSet.isGoodSet())
             {
-                AiModelState newState(initialState);
-                removeCardFromGroups(newState, freeCard);
-                modifySet(newState, newSet);
-                verifyChangedState(initialState, newState);
+                AiSearchUndoLog::Mark mark(state.mark());
+                removeCardFromGroups(state, freeCard);
+                modifySet(state, i, newSet);
+                verifyChangedState(state);
 
-                turnPlay = findOneSimpleTurnPlay(newState, depth + 1);
+                turnPlay = searchRearrangedState(state, depth + 1, deferredStates);
+                state.undo(mark);
                 if (!turnPlay.isNull())
                     return turnPlay;
             }
@@ -807,41 +1564,43 @@ AiModelState AiModel::searchEquivalent1FreeCardMoveStates(const AiModelState &in
     return {};
 }
 
-AiModelState AiModel::searchEquivalent1JoinSetsStates(const AiModelState &initialState, int depth) const
+AiSearchState AiModel::searchEquivalent1JoinSetsStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const
 {
-    AiModelState turnPlay;
+    AiSearchState turnPlay;
+    StrategyProfile profile(JoinSetsStrategy, depth, _searchSettings.profileStrategies);
 
     // for each complete run set, join onto each other complete run set and search again
-    for (const CardGroup &existingSet1 : initialState.cardGroups)
+    for (int i = 0; i < state.groupCount; i++)
     {
+        const CardMask existingSet1(state.cardGroups[i]);
         if (existingSet1.count() < 2)
             continue;
-        statistics.isGoodSetCalls++;
-        if (!existingSet1.isGoodRunSet())
+        const AiSetClassifications::Classification &classification1(classifySet(existingSet1));
+        if (!(classification1.isGoodSet && classification1.setType == CardGroup::RunSet))
             continue;
-        for (const CardGroup &existingSet2 : initialState.cardGroups)
+        for (int j = 0; j < state.groupCount; j++)
         {
-            if (existingSet2 == existingSet1)
+            const CardMask existingSet2(state.cardGroups[j]);
+            if (j == i)
                 continue;
             if (existingSet2.count() < 2)
                 continue;
-            statistics.isGoodSetCalls++;
-            if (!existingSet2.isGoodRunSet())
+            const AiSetClassifications::Classification &classification2(classifySet(existingSet2));
+            if (!(classification2.isGoodSet && classification2.setType == CardGroup::RunSet))
                 continue;
-            if (existingSet2.first()->suit() != existingSet1.first()->suit())
+            if (Card::suitOf(existingSet2.first()) != Card::suitOf(existingSet1.first()))
                 continue;
-            CardGroup newSet(existingSet1);
-            newSet.append(existingSet2);
-            newSet.rearrangeForSets();
+            CardMask newSet(existingSet1 | existingSet2);
             statistics.isGoodSetCalls++;
             if (newSet.isGoodRunSet())
             {
-                AiModelState newState(initialState);
-                removeCardsFromOneGroup(newState, existingSet2);
-                modifySet(newState, newSet);
-                verifyChangedState(initialState, newState);
+                AiSearchUndoLog::Mark mark(state.mark());
+                removeCardsFromOneGroup(state, existingSet2);
+                modifySet(state, i, newSet);
+                verifyChangedState(state);
 
-                turnPlay = findOneSimpleTurnPlay(newState, depth + 1);
+                turnPlay = searchRearrangedState(state, depth + 1, deferredStates);
+                state.undo(mark);
                 if (!turnPlay.isNull())
                     return turnPlay;
             }
@@ -851,35 +1610,42 @@ AiModelState AiModel::searchEquivalent1JoinSetsStates(const AiModelState &initia
     return {};
 }
 
-AiModelState AiModel::searchEquivalent1SplitSetsStates(const AiModelState &initialState, int depth) const
+AiSearchState AiModel::searchEquivalent1SplitSetsStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const
 {
-    AiModelState turnPlay;
+    AiSearchState turnPlay;
+    StrategyProfile profile(SplitSetsStrategy, depth, _searchSettings.profileStrategies);
 
     // for each long complete run set, split into each other short complete run set and search again
-    for (const CardGroup &existingSet : initialState.cardGroups)
+    for (int i = 0; i < state.groupCount; i++)
     {
+        const CardMask existingSet(state.cardGroups[i]);
         if (existingSet.count() < 6)
             continue;
-        statistics.isGoodSetCalls++;
-        if (!existingSet.isGoodRunSet())
+        const AiSetClassifications::Classification &classification(classifySet(existingSet));
+        if (!(classification.isGoodSet && classification.setType == CardGroup::RunSet))
             continue;
-        for (int splitIndex = 3; splitIndex <= existingSet.count() - 3; splitIndex++)
+        int cards[CardMask::MaxCards];
+        int cardCount = existingSet.arrangedCardIds(cards);
+        for (int splitIndex = 3; splitIndex <= cardCount - 3; splitIndex++)
         {
-            CardGroup existingSet1(existingSet);
-            CardGroup newSet;
-            while (splitIndex < existingSet1.count())
-                newSet.append(existingSet1.takeAt(splitIndex));
+            CardMask existingSet1, newSet;
+            for (int k = 0; k < cardCount; k++)
+                if (k < splitIndex)
+                    existingSet1.insert(cards[k]);
+                else
+                    newSet.insert(cards[k]);
             Q_ASSERT(existingSet1.isGoodRunSet());
             Q_ASSERT(newSet.isGoodRunSet());
             statistics.isGoodSetCalls++;
             if (existingSet1.isGoodRunSet() && newSet.isGoodRunSet())
             {
-                AiModelState newState(initialState);
-                modifySet(newState, existingSet1);
-                addNewSet(newState, newSet);
-                verifyChangedState(initialState, newState);
+                AiSearchUndoLog::Mark mark(state.mark());
+                modifySet(state, i, existingSet1);
+                addNewSet(state, newSet);
+                verifyChangedState(state);
 
-                turnPlay = findOneSimpleTurnPlay(newState, depth + 1);
+                turnPlay = searchRearrangedState(state, depth + 1, deferredStates);
+                state.undo(mark);
                 if (!turnPlay.isNull())
                     return turnPlay;
             }
@@ -889,94 +1655,213 @@ AiModelState AiModel::searchEquivalent1SplitSetsStates(const AiModelState &initi
     return {};
 }
 
-AiModelState AiModel::searchEquivalent3RearrangeSetsStates(const AiModelState &initialState, int depth) const
+AiSearchState AiModel::searchEquivalent3RearrangeSetsStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const
 {
-    AiModelState turnPlay;
+    AiSearchState turnPlay;
+    StrategyProfile profile(RearrangeSetsStrategy, depth, _searchSettings.profileStrategies);
 
     // for each 3 complete sets which are all rank (of consecutive values) or run (of same ranks)
     // rearrange them to make 3 complete sets of runs (if was ranks) or ranks (if was runs)
     // and search again
-    for (const CardGroup &existingSet1 : initialState.cardGroups)
+    // (the rearranged sets are added after the groups, so only look at the groups there were to start with)
+    // only 3 sets which could pivot are looked at together, and each 3 only once:
+    // rank sets of the same 3 suits at 3 consecutive ranks, or run sets of the same 3 ranks in 3 different suits
+    // so the 3-card sets are first bucketed, rank sets keyed by rank & suits, run sets keyed by ranks & suit
+    struct PivotCandidate
     {
-        if (existingSet1.count() != 3)
+        int key;
+        int index;
+    };
+    AiArenaList<PivotCandidate> rankSets, runSets;
+    int groupCount = state.groupCount;
+    for (int i = 0; i < groupCount; i++)
+    {
+        const CardMask existingSet(state.cardGroups[i]);
+        if (existingSet.count() != 3)
             continue;
-        CardGroup::SetType setType1;
-        statistics.isGoodSetCalls++;
-        if (!existingSet1.isGoodSet(setType1))
+        const AiSetClassifications::Classification &classification(classifySet(existingSet));
+        if (!classification.isGoodSet)
             continue;
-        for (const CardGroup &existingSet2 : initialState.cardGroups)
+        int ranks = 0, suits = 0;
+        for (int card : existingSet)
+        {
+            ranks |= 1 << Card::rankOf(card);
+            suits |= 1 << Card::suitOf(card);
+        }
+        if (classification.setType == CardGroup::RankSet)
+            rankSets.append({ Card::rankOf(existingSet.first()) * 16 + suits, i });
+        else
+            runSets.append({ ranks * 4 + Card::suitOf(existingSet.first()), i });
+    }
+    auto byKey = [](const PivotCandidate &a, const PivotCandidate &b) { return a.key < b.key; };
+    std::sort(rankSets.begin(), rankSets.end(), byKey);
+    std::sort(runSets.begin(), runSets.end(), byKey);
+
+    auto searchPivotedSets = [&](int i, int j, int k) -> AiSearchState {
+        AiArenaList<CardMask> existingSets({state.cardGroups[i], state.cardGroups[j], state.cardGroups[k]});
+        AiArenaList<CardMask> newSets = pivotSets(existingSets);
+        Q_ASSERT(newSets.count() == existingSets.count());
+        for (const CardMask &newSet : newSets)
         {
-            if (existingSet2 == existingSet1)
-                continue;
-            if (existingSet2.count() != existingSet1.count())
-                continue;
             statistics.isGoodSetCalls++;
-            if (!existingSet2.isGoodSetOfType(setType1))
+            if (!newSet.isGoodSet())
+                return {};
+        }
+        AiSearchUndoLog::Mark mark(state.mark());
+        clearSet(state, i);
+        clearSet(state, j);
+        clearSet(state, k);
+        for (const CardMask &newSet : newSets)
+            addNewSet(state, newSet);
+        verifyChangedState(state);
+
+        AiSearchState turnPlay = searchRearrangedState(state, depth + 1, deferredStates);
+        state.undo(mark);
+        return turnPlay;
+    };
+
+    // rank sets: each is the lowest of the 3 consecutive ranks once, with the same suits at the next 2 ranks
+    // (whether the ranks may wrap around at the Ace is left to the new sets' checks)
+    for (const PivotCandidate &rankSet1 : rankSets)
+    {
+        int rank1 = rankSet1.key / 16, suits = rankSet1.key % 16;
+        auto rankSets2 = std::equal_range(rankSets.begin(), rankSets.end(), PivotCandidate{ (rank1 + 1) % 13 * 16 + suits, -1 }, byKey);
+        auto rankSets3 = std::equal_range(rankSets.begin(), rankSets.end(), PivotCandidate{ (rank1 + 2) % 13 * 16 + suits, -1 }, byKey);
+        for (auto rankSet2 = rankSets2.first; rankSet2 != rankSets2.second; ++rankSet2)
+            for (auto rankSet3 = rankSets3.first; rankSet3 != rankSets3.second; ++rankSet3)
+            {
+                turnPlay = searchPivotedSets(rankSet1.index, rankSet2->index, rankSet3->index);
+                if (!turnPlay.isNull())
+                    return turnPlay;
+            }
+    }
+
+    // run sets: the same ranks are next to each other, in order of suit
+    for (auto runSet1 = runSets.begin(); runSet1 != runSets.end(); ++runSet1)
+        for (auto runSet2 = runSet1 + 1; runSet2 != runSets.end() && runSet2->key / 4 == runSet1->key / 4; ++runSet2)
+        {
+            if (runSet2->key == runSet1->key)
                 continue;
-            for (const CardGroup &existingSet3 : initialState.cardGroups)
+            for (auto runSet3 = runSet2 + 1; runSet3 != runSets.end() && runSet3->key / 4 == runSet1->key / 4; ++runSet3)
             {
-                if (existingSet3 == existingSet1 || existingSet3 == existingSet2)
-                    continue;
-                if (existingSet3.count() != existingSet1.count())
+                if (runSet3->key == runSet2->key)
                     continue;
-                statistics.isGoodSetCalls++;
-                if (!existingSet3.isGoodSetOfType(setType1))
-                    continue;
-                CardGroups existingSets(CardGroups({existingSet1, existingSet2, existingSet3}));
-                CardGroups newSets = pivotSets(existingSets);
-                Q_ASSERT(newSets.count() == existingSets.count());
-                bool badSet = false;
-                for (CardGroup &newSet : newSets)
-                {
-                    newSet.rearrangeForSets();
-                    statistics.isGoodSetCalls++;
-                    if (!newSet.isGoodSet())
-                        badSet = true;
-                }
-                if (!badSet)
-                {
-                    AiModelState newState(initialState);
-                    for (const CardGroup &existingSet : existingSets)
-                        clearSet(newState, existingSet);
-                    for (const CardGroup &newSet : newSets)
-                        addNewSet(newState, newSet);
-                    verifyChangedState(initialState, newState);
-
-                    turnPlay = findOneSimpleTurnPlay(newState, depth + 1);
-                    if (!turnPlay.isNull())
-                        return turnPlay;
-                }
+                turnPlay = searchPivotedSets(runSet1->index, runSet2->index, runSet3->index);
+                if (!turnPlay.isNull())
+                    return turnPlay;
             }
         }
-    }
 
     return {};
 }
 
 
-AiModelState AiModel::searchEquivalentInitialStates(const AiModelState &initialState, int depth) const
+int AiModel::scoreRearrangedState(const AiSearchState &state) const
 {
-    AiModelState turnPlay;
+    // how promising a rearranged state looks, the higher the more promising
+    // all the states with fewer rearrangements have already been searched (deepening one rearrangement at a time), so none of these has a simple play,
+    // instead count how many free cards each card in hand could make a set with, given one more card, which a further rearrangement might free
+    const AiFreeCardIndex freeCardIndex(indexFreeCardsInGroups(state));
+    int score = 0;
+    for (int card : state.aiHand)
+    {
+        int rank = Card::rankOf(card), suit = Card::suitOf(card);
+        score += (freeCardIndex.freeCardsOfRank[rank] - freeCardIndex.freeCardsOfSuit[suit]).count();
+        for (int rankDifference = -2; rankDifference <= 2; rankDifference++)
+            if (rankDifference != 0 && freeCardIndex.freeCards.findCard(suit, (rank + rankDifference + 13) % 13) >= 0)
+                score++;
+    }
+    return score;
+}
+
+void AiModel::orderRearrangedStates(AiSearchStates &states) const
+{
+    // most promising first, otherwise keeping the order they were made in
+    AiArenaList<int> scores;
+    scores.reserve(states.count());
+    for (const AiSearchState &state : states)
+        scores.append(scoreRearrangedState(state));
+    AiArenaList<int> order;
+    order.reserve(states.count());
+    for (int i = 0; i < states.count(); i++)
+        order.append(i);
+    std::stable_sort(order.begin(), order.end(), [&scores](int a, int b) { return scores.at(a) > scores.at(b); });
+    AiSearchStates orderedStates;
+    orderedStates.reserve(states.count());
+    for (int i : order)
+        orderedStates.append(states.at(i));
+    states.swap(orderedStates);
+}
+
+AiSearchState AiModel::searchEquivalentInitialStates(AiSearchState &state, int depth) const
+{
+    AiSearchState turnPlay;
+
+    // only the first rearrangements of the initial state are searched in parallel, further ones are searched within those threads
+    // then each rearrangement is made in place and searched after all of them have been made
+    bool inParallel = !_searchSettings.deterministic && depth == 0;
+
+    // when ordering, all the rearrangements are made (and kept) first, then searched most promising first
+    // (not worth it for the last rearrangement, whose states are searched no further than `findOneSimpleTurnPlay()`, which costs about as much as scoring them)
+    if (_searchSettings.orderRearrangements && _searchMaxDepth - (depth + 1) > 0)
+    {
+        AiSearchStates rearrangedStates;
+        searchEquivalent1FreeCardMoveStates(state, depth, &rearrangedStates);
+        searchEquivalent1JoinSetsStates(state, depth, &rearrangedStates);
+        searchEquivalent1SplitSetsStates(state, depth, &rearrangedStates);
+        searchEquivalent3RearrangeSetsStates(state, depth, &rearrangedStates);
+        if (rearrangedStates.isEmpty())
+            return {};
+        orderRearrangedStates(rearrangedStates);
+        if (inParallel)
+            return searchEquivalentStatesInParallel(rearrangedStates, depth + 1);
+        for (const AiSearchState &rearrangedState : rearrangedStates)
+        {
+            AiSearchState workingState(rearrangedState);
+            workingState.undoLog = state.undoLog;
+            turnPlay = searchEquivalentState(workingState, depth + 1);
+            if (!turnPlay.isNull())
+                return turnPlay;
+        }
+        return {};
+    }
+    AiSearchStates deferredStates;
+    AiSearchStates *deferred = inParallel ? &deferredStates : nullptr;
+    auto searchDeferredStates = [&]() -> AiSearchState {
+        if (deferredStates.isEmpty())
+            return {};
+        AiSearchState turnPlay = searchEquivalentStatesInParallel(deferredStates, depth + 1);
+        deferredStates.clear();
+        return turnPlay;
+    };
 
     // for each free card, move to each other (complete) set and search again
-    turnPlay = searchEquivalent1FreeCardMoveStates(initialState, depth);
+    turnPlay = searchEquivalent1FreeCardMoveStates(state, depth, deferred);
+    if (inParallel)
+        turnPlay = searchDeferredStates();
     if (!turnPlay.isNull())
         return turnPlay;
 
     // for each complete run set, join onto each other complete run set and search again
-    turnPlay = searchEquivalent1JoinSetsStates(initialState, depth);
+    turnPlay = searchEquivalent1JoinSetsStates(state, depth, deferred);
+    if (inParallel)
+        turnPlay = searchDeferredStates();
     if (!turnPlay.isNull())
         return turnPlay;
 
     // for each long complete run set, split into each other short complete run set and search again
-    turnPlay = searchEquivalent1SplitSetsStates(initialState, depth);
+    turnPlay = searchEquivalent1SplitSetsStates(state, depth, deferred);
+    if (inParallel)
+        turnPlay = searchDeferredStates();
     if (!turnPlay.isNull())
         return turnPlay;
 
     // for each 3 complete sets which are all rank (of consecutive values) or run (of same ranks)
     // rearrange them to make 3 complete sets of runs (if was ranks) or ranks (if was runs)
     // and search again
-    turnPlay = searchEquivalent3RearrangeSetsStates(initialState, depth);
+    turnPlay = searchEquivalent3RearrangeSetsStates(state, depth, deferred);
+    if (inParallel)
+        turnPlay = searchDeferredStates();
     if (!turnPlay.isNull())
         return turnPlay;
 
@@ -984,12 +1869,12 @@ AiModelState AiModel::searchEquivalentInitialStates(const AiModelState &initialS
 }
 
 
-AiModelState AiModel::findOneComplexTurnPlay(const AiModelState &initialState, int depth) const
+AiSearchState AiModel::findOneComplexTurnPlay(AiSearchState &state, int depth) const
 {
-    AiModelState turnPlay;
+    AiSearchState turnPlay;
 
     // rearrange initial state to equivalents and search in them
-    turnPlay = searchEquivalentInitialStates(initialState, depth);
+    turnPlay = searchEquivalentInitialStates(state, depth);
     if (!turnPlay.isNull())
         return turnPlay;
 
@@ -997,32 +1882,410 @@ AiModelState AiModel::findOneComplexTurnPlay(const AiModelState &initialState, i
 }
 
 
-AiModelState AiModel::findOneTurnPlay() const
+AiSearchState AiModel::initialSearchState() const
 {
-    const AiModelState initialState(aiHand(), cardGroups());
+    // make the compact search state from the AI hand & the groups on the baize
+    // every legal position fits (`MaxBaizeGroups`), so only a position made by hand can have too many groups to search,
+    // when the null state is returned, which has no play
+    AiSearchState state;
+    if (cardGroups().count() > MaxSearchGroups)
+    {
+        qWarning() << __FUNCTION__ << "Not a legal position, too many groups to search:" << cardGroups().count();
+        return state;
+    }
+    state.aiHand = CardMask(aiHand());
+    for (const CardGroup &group : cardGroups())
+        addNewSet(state, CardMask(group));
+    state.hash = stateHash(state);
+    return state;
+}
+
+AiModelState AiModel::turnPlayFromSearchState(const AiSearchState &state) const
+{
+    // make the turn play from the compact search state
+    // groups which were on the baize keep their unique ids (so the caller can see which have been modified/cleared)
+    // new groups are made with new unique ids
+    QList<const Card *> cardsById(cards().count());
+    for (const Card *card : cards())
+        cardsById[card->id] = card;
+
     AiModelState turnPlay;
+    for (const Card *card : aiHand())
+        if (state.aiHand.contains(card->id))
+            turnPlay.aiHand.append(card);
+    turnPlay.cardGroups = cardGroups();
+    Q_ASSERT(state.groupCount >= turnPlay.cardGroups.count());
 
-    turnPlay = findOneSimpleTurnPlay(initialState, 0);
-    if (!turnPlay.isNull())
-        return turnPlay;
+    for (int i = 0; i < state.groupCount; i++)
+    {
+        const CardMask &group(state.cardGroups[i]);
+        if (i < cardGroups().count() && group == CardMask(cardGroups().at(i)))
+            continue;
+        if (i >= cardGroups().count() && group.isEmpty())
+            continue;
+        int cards[CardMask::MaxCards];
+        int cardCount = group.arrangedCardIds(cards);
+        CardGroup newSet;
+        CardGroup &changedSet(i < cardGroups().count() ? turnPlay.cardGroups[i] : newSet);
+        changedSet.clear();
+        for (int k = 0; k < cardCount; k++)
+            changedSet.append(cardsById.at(cards[k]));
+        changedSet.rearrangeForSets();
+        if (i >= cardGroups().count())
+            turnPlay.cardGroups.append(newSet);
+    }
+    return turnPlay;
+}
+
+AiSearchState AiModel::findOneRearrangedTurnPlay(AiSearchState &state)
+{
+    // deepen the search one rearrangement at a time, until a play is found or the search budget runs out
+    // so the play found is one needing the fewest rearrangements of the baize
+    AiSearchState turnPlay;
+    for (_searchMaxDepth = 1; turnPlay.isNull() && _searchMaxDepth <= qMin(_searchSettings.maxRearrangeDepth, MaxRearrangeDepth); _searchMaxDepth++)
+    {
+        if (searchBudgetExhausted() || turnCancelled())
+            break;
+        statistics.searchDepth = qMax(statistics.searchDepth, _searchMaxDepth);
+        emit makeTurnProgress(_turnNumber, _searchMaxDepth, _searchNodes.loadRelaxed());
+        turnPlay = findOneComplexTurnPlay(state, 0);
+        Q_ASSERT(state.undoLog->changeCount() == 0);
+    }
+    return turnPlay;
+}
+
+
+void AiModel::findAllSimpleTurnPlays(AiSearchState &state, AiSearchStates &turnPlays) const
+{
+    // all the plays from every stage of `findOneSimpleTurnPlay()`, not just those from the first stage which finds any
+    AiTurnPlayChooser collector(true, &turnPlays);
+    findAllCompleteSetsInHand(state, collector);
+    findAllCompleteSetsFrom2CardsInHand(state, collector);
+    findAllAddToCompleteSetsFrom1CardInHand(state, collector);
+    findAllCompleteSetsFrom1CardInHand(state, collector);
+}
+
+bool AiModel::couldMakeSetWith(int card, const CardMask &cards, const CardMask &partners) const
+{
+    // whether `card` makes a set of 3 with 2 of `cards`, at least 1 of them from `partners` (which are among `cards`)
+    int rank = Card::rankOf(card), suit = Card::suitOf(card);
+    int otherSuits = 0, otherPartnerSuits = 0;
+    for (int suit1 = 0; suit1 < 4; suit1++)
+        if (suit1 != suit && cards.findCard(suit1, rank) >= 0)
+        {
+            otherSuits++;
+            if (partners.findCard(suit1, rank) >= 0)
+                otherPartnerSuits++;
+        }
+    if (otherSuits >= 2 && otherPartnerSuits >= 1)
+        return true;
+    // or a run of 3 in its suit with it at the bottom, in the middle or at the top (allowing for the "wraparound" at an Ace)
+    for (int bottom = rank - 2; bottom <= rank; bottom++)
+    {
+        bool couldMake = true, withPartner = false;
+        for (int rank1 = bottom; couldMake && rank1 < bottom + 3; rank1++)
+            if (rank1 != rank)
+            {
+                couldMake = (cards.findCard(suit, (rank1 + 13) % 13) >= 0);
+                withPartner = withPartner || (partners.findCard(suit, (rank1 + 13) % 13) >= 0);
+            }
+        if (couldMake && withPartner)
+            return true;
+    }
+    return false;
+}
+
+int AiModel::countHandCardsWhichCouldJoinSets(const AiSearchState &state) const
+{
+    // an upper bound on how many more cards from hand could be played this turn
+    // a card could only ever join a set if, somewhere in hand or on the baize, there are 2 other cards which make a set with it
+    // (the cards in hand & on the baize between them do not change during the turn, only which groups they are in)
+    int count = 0;
+    for (int card : state.aiHand)
+        if (couldMakeSetWith(card, _searchCards, _searchCards))
+            count++;
+    return count;
+}
+
+bool AiModel::anyHandCardCouldBePlayed(const AiSearchState &state) const
+{
+    // the "no play possible" filter: a necessary condition for the search to find a play, checked before it
+    // once the baize may be rearranged any card on it could end up free (pivoting 3 sets frees all their cards, splitting a run its middle ones),
+    // so then a card in hand is only checked against all the cards there are
+    if (_searchSettings.maxRearrangeDepth > 0)
+        return countHandCardsWhichCouldJoinSets(state) > 0;
+
+    // without rearranging, a card in hand can only make a new set with the other cards in hand, the free cards,
+    // and the 2 cards at either end of a run of 5 or more,
+    // or, together with another card in hand, with any card of a set of 3 (whose other 2 cards then go onto other sets)
+    // or it can join a set: a rank set without its suit, or a run set next to one of its ends
+    CardMask cards(state.aiHand | findAllFreeCardsInGroups(state)), cardsOf3Sets;
+    bool couldJoin[4][13] = {};
+    for (int i = 0; i < state.groupCount; i++)
+    {
+        const CardMask &group(state.cardGroups[i]);
+        const AiSetClassifications::Classification &classification(classifySet(group));
+        if (!classification.isGoodSet)
+            continue;
+        if (group.count() == 3)
+            cardsOf3Sets |= group;
+        int groupCards[CardMask::MaxCards];
+        int cardCount = group.arrangedCardIds(groupCards);
+        if (classification.setType == CardGroup::RankSet)
+        {
+            int rank = Card::rankOf(groupCards[0]);
+            for (int suit = 0; suit < 4; suit++)
+                if (group.findCard(suit, rank) < 0)
+                    couldJoin[suit][rank] = true;
+        }
+        else if (cardCount < 13)
+        {
+            int suit = Card::suitOf(groupCards[0]);
+            couldJoin[suit][(Card::rankOf(groupCards[0]) + 12) % 13] = true;
+            couldJoin[suit][(Card::rankOf(groupCards[cardCount - 1]) + 1) % 13] = true;
+            if (cardCount >= 5)
+            {
+                cards.insert(groupCards[1]);
+                cards.insert(groupCards[cardCount - 2]);
+            }
+        }
+    }
+    for (int card : state.aiHand)
+    {
+        if (couldJoin[Card::suitOf(card)][Card::rankOf(card)])
+            return true;
+        if (couldMakeSetWith(card, cards, cards))
+            return true;
+        if (couldMakeSetWith(card, cards | cardsOf3Sets, state.aiHand - CardMask::fromId(card)))
+            return true;
+    }
+    return false;
+}
+
+bool AiModel::planBudgetExhausted(const AiTurnPlan &plan) const
+{
+    if (searchBudgetExhausted() || turnCancelled())
+        return true;
+    return (_searchSettings.planNodeLimit > 0 && plan.nodesExpanded >= _searchSettings.planNodeLimit);
+}
+
+void AiModel::planTurnThroughPlays(AiSearchStates &turnPlays, AiTurnPlan &plan)
+{
+    // try the plays which play the most cards first, so that a good best so far is found early, to cut off more branches
+    std::stable_sort(turnPlays.begin(), turnPlays.end(),
+                     [](const AiSearchState &a, const AiSearchState &b) { return a.aiHand.count() < b.aiHand.count(); });
+    for (AiSearchState &turnPlay : turnPlays)
+    {
+        if (planBudgetExhausted(plan))
+            return;
+        int cardsPlayed = plan.handCount - turnPlay.aiHand.count();
+        if (cardsPlayed + countHandCardsWhichCouldJoinSets(turnPlay) <= plan.bestCardsPlayed)
+        {
+            plan.nodesPruned++;
+            continue;
+        }
+        turnPlay.undoLog = plan.undoLog;
+        planTurnFrom(turnPlay, plan);
+    }
+}
+
+void AiModel::planTurnFrom(AiSearchState &state, AiTurnPlan &plan)
+{
+    if (plan.plannedFrom.contains(state.hash))
+    {
+        plan.nodesPruned++;
+        return;
+    }
+    plan.plannedFrom.insert(state.hash);
+    plan.nodesExpanded++;
+
+    int cardsPlayed = plan.handCount - state.aiHand.count();
+    if (cardsPlayed > plan.bestCardsPlayed)
+    {
+        plan.best = state;
+        plan.bestCardsPlayed = cardsPlayed;
+    }
+    // another play needs room for the groups it (and its rearrangements) may add
+    if (state.aiHand.isEmpty() || state.groupCount + 3 * (MaxRearrangeDepth + 1) > AiSearchState::MaxGroups)
+        return;
+
+    AiSearchArena::Scope arenaScope;
+    AiSearchStates turnPlays;
+    findAllSimpleTurnPlays(state, turnPlays);
+    if (turnPlays.isEmpty())
+    {
+        AiSearchState turnPlay(findOneRearrangedTurnPlay(state));
+        if (turnPlay.isNull())
+            return;
+        turnPlays.append(turnPlay);
+    }
+    planTurnThroughPlays(turnPlays, plan);
+}
+
+AiSearchState AiModel::planTurn(AiSearchState &state, const AiSearchState &firstTurnPlay)
+{
+    // branch & bound over chains of plays (sets from hand, additions to the baize, rearrangements), to play as many cards from hand as possible
+    // it starts again from the start of the turn, so that other first plays are tried too, with the play already found as the best so far
+    // a branch is cut off when even playing every card in hand which could still join a set would not beat the best so far
+    AiTurnPlan plan;
+    plan.handCount = state.aiHand.count();
+    plan.best = firstTurnPlay;
+    plan.undoLog = state.undoLog;
+    plan.bestCardsPlayed = plan.handCount - firstTurnPlay.aiHand.count();
+    plan.nodesExpanded = plan.nodesPruned = 0;
+    plan.plannedFrom.insert(state.hash);
+
+    AiSearchStates turnPlays;
+    findAllSimpleTurnPlays(state, turnPlays);
+    // the play already found needed rearrangements, the only such play searched for
+    if (turnPlays.isEmpty())
+        turnPlays.append(firstTurnPlay);
+    planTurnThroughPlays(turnPlays, plan);
+
+    statistics.planNodesExpanded = plan.nodesExpanded;
+    statistics.planNodesPruned = plan.nodesPruned;
+    statistics.planCardsPlayed = plan.bestCardsPlayed;
+    if (debugLevel() >= 2)
+        qDebug() << "    " << __FUNCTION__ << "Cards played:" << plan.bestCardsPlayed << "of" << plan.handCount
+                 << "nodes expanded:" << plan.nodesExpanded << "pruned:" << plan.nodesPruned;
+    return plan.best;
+}
+
+
+AiSearchState AiModel::beginSearch()
+{
+    // make ready to search the snapshot, and return the state to search from
+    _initialFreeCards = CardMask(_snapshot.initialFreeCards());
+    _noPlayStates.clear();
+    _searchCancelled.storeRelaxed(0);
+    _searchNodes.storeRelaxed(0);
+    _searchBudgetExhausted.storeRelaxed(SearchBudgetLeft);
+    _searchTimer.start();
+    AiSearchState state(initialSearchState());
+    _searchCards = state.aiHand;
+    for (int i = 0; i < state.groupCount; i++)
+        _searchCards |= state.cardGroups[i];
+    return state;
+}
 
-    turnPlay = findOneComplexTurnPlay(initialState, 0);
+AiModelState AiModel::findOneTurnPlay()
+{
+    // the search works on one state, changing it in place and undoing the changes afterwards
+    AiSearchUndoLog undoLog;
+    AiSearchState state(beginSearch());
+    state.undoLog = &undoLog;
+    AiSearchState turnPlay;
+
+    // the fast path: when no card in hand could be played, with the cards free on the baize or however the baize may be rearranged,
+    // there is no play to search for
+    // (as there is when the position has too many groups to search)
+    bool noPlayPossible = state.isNull();
+    if (!noPlayPossible && _searchSettings.noPlayFilter)
+    {
+        QElapsedTimer filterTimer;
+        filterTimer.start();
+        noPlayPossible = !anyHandCardCouldBePlayed(state);
+        statistics.noPlayFilterNs = filterTimer.nsecsElapsed();
+        statistics.noPlayFilterChecks++;
+        if (noPlayPossible)
+        {
+            statistics.noPlayFilterHits++;
+            if (_searchSettings.measureNoPlayFilter)
+            {
+                // search anyway, to see what the filter saved, then put the search & its statistics back as if it had not been made
+                const Statistics filterStatistics(statistics);
+                QElapsedTimer savedTimer;
+                savedTimer.start();
+                AiSearchState skippedPlay(findOneSimpleTurnPlay(state, 0));
+                if (skippedPlay.isNull())
+                    skippedPlay = findOneRearrangedTurnPlay(state);
+                Q_ASSERT(skippedPlay.isNull());
+                const qint64 savedNs = savedTimer.nsecsElapsed();
+                const long savedNodes = _searchNodes.loadRelaxed();
+                statistics = filterStatistics;
+                statistics.noPlayFilterSavedNs = savedNs;
+                statistics.noPlayFilterSavedNodes = savedNodes;
+                _noPlayStates.clear();
+                _searchNodes.storeRelaxed(0);
+                _searchBudgetExhausted.storeRelaxed(SearchBudgetLeft);
+                _searchTimer.start();
+            }
+        }
+    }
+
+    if (!noPlayPossible)
+    {
+        turnPlay = findOneSimpleTurnPlay(state, 0);
+        if (turnPlay.isNull())
+            turnPlay = findOneRearrangedTurnPlay(state);
+    }
     if (!turnPlay.isNull())
-        return turnPlay;
+        statistics.searchNodesToSolution = _searchNodes.loadRelaxed();
+
+    if (_searchSettings.planTurn && !turnPlay.isNull())
+    {
+        // (the planning searches again, so keep the strategy which found the play)
+        int chosenStrategy = statistics.chosenStrategy, chosenDepth = statistics.chosenDepth;
+        {
+            StrategyProfile profile(PlanTurnStrategy, 0, _searchSettings.profileStrategies);
+            turnPlay = planTurn(state, turnPlay);
+        }
+        statistics.chosenStrategy = chosenStrategy;
+        statistics.chosenDepth = chosenDepth;
+    }
+
+    statistics.searchNodes = _searchNodes.loadRelaxed();
+    statistics.searchElapsedMs = _searchTimer.elapsed();
+    statistics.searchTimeLimitHit = _searchBudgetExhausted.loadRelaxed() == SearchTimeLimitHit;
+    statistics.searchNodeLimitHit = _searchBudgetExhausted.loadRelaxed() == SearchNodeLimitHit;
 
+    if (!turnPlay.isNull())
+        return turnPlayFromSearchState(turnPlay);
     return {};
 }
 
 
-/*slot*/ void AiModel::makeTurn()
+void AiModel::cancelTurn(int turnNumber)
 {
+    // may be called from any thread, while a turn is being made
+    // turn numbers only go up, so this cancels the turn numbered `turnNumber` and any before it
+    _cancelledTurnNumber.storeRelaxed(turnNumber);
+}
+
+/*slot*/ void AiModel::makeTurn(const LogicalModelSnapshot &snapshot, int turnNumber)
+{
+    _snapshot = snapshot;
+    _turnNumber = turnNumber;
+    if (turnCancelled())
+        return;
     Q_ASSERT(hands().isAiPlayer(activePlayer()));
 
     resetStatistics();
+    const long groupClassificationHits = CardGroup::classificationHits(), groupClassificationMisses = CardGroup::classificationMisses();
 
+    QElapsedTimer turnTimer;
+    turnTimer.start();
     AiModelState turnPlay = findOneTurnPlay();
+    const qint64 turnElapsedNs = turnTimer.nsecsElapsed();
+    statistics.groupClassificationHits = CardGroup::classificationHits() - groupClassificationHits;
+    statistics.groupClassificationMisses = CardGroup::classificationMisses() - groupClassificationMisses;
+    // (the search's containers have all gone by now)
+    AiSearchArena::current().reset();
 
     showStatistics();
-
-    emit makeTurnPlay(turnPlay);
+    if (_searchSettings.profileStrategies && !_searchSettings.profileFilePath.isEmpty())
+        writeStrategyProfile(turnNumber, turnCancelled());
+    if (!_searchSettings.slowPositionsPath.isEmpty() && !turnCancelled())
+        if ((_searchSettings.slowTurnMs > 0 && turnElapsedNs >= qint64(_searchSettings.slowTurnMs) * 1000000)
+            || (_searchSettings.slowTurnStates > 0 && statistics.aiModelStatesCreated >= _searchSettings.slowTurnStates))
+            writeSlowPosition(turnNumber, turnElapsedNs);
+
+    // a cancelled turn's play is of no interest, the model it was made from has (probably) already changed
+    if (turnCancelled())
+    {
+        if (debugLevel() >= 1)
+            qDebug() << __FUNCTION__ << "Turn cancelled:" << turnNumber;
+        return;
+    }
+    emit makeTurnPlay(turnNumber, turnPlay);
 }
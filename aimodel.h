@@ -1,8 +1,16 @@
 #ifndef AIMODEL_H
 #define AIMODEL_H
 
+#include <vector>
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QObject>
+#include <QSet>
 
+#include "cardmask.h"
 #include "logicalmodel.h"
 
 class AiModelState
@@ -18,9 +26,250 @@ public:
 
 
 
-class AiModelStates : public QList<AiModelState>
+class AiSearchUndoLog
+{
+    // the changes made in place to a working `AiSearchState`, so that they can be undone back to a mark
+    // only the previous contents of changed groups need recording; the hand, the group count & the hash are saved in the mark
+public:
+    struct Mark
+    {
+        int changeCount;
+        int groupCount;
+        CardMask aiHand;
+        quint64 hash;
+    };
+    struct Change
+    {
+        int index;
+        CardMask previousSet;
+    };
+
+    int changeCount() const { return _changes.count(); }
+    void recordChange(int index, const CardMask &previousSet) { _changes.append({ index, previousSet }); }
+    Change takeLastChange() { return _changes.takeLast(); }
+
+private:
+    QList<Change> _changes;
+};
+
+
+
+class AiSearchState
+{
+    // compact state used during the search
+    // the hand & each group are held as `CardMask`s; groups are only ever appended or cleared, never removed,
+    // so the first groups correspond by index to the groups on the baize at the start of the search
+    // a working state has an `undoLog`, and is changed in place and then undone back to a `mark()`
+    // copies are made only of states to be kept (turn plays, or rearranged states to be searched by other threads),
+    // and do not share the undo log
+public:
+    // (room for the groups of any legal position, `AiModel::MaxBaizeGroups`, and all the groups the deepest search can add to them)
+    static constexpr int MaxGroups = 52;
+    CardMask aiHand;
+    int groupCount;
+    CardMask cardGroups[MaxGroups];
+    quint64 hash;
+    AiSearchUndoLog *undoLog;
+
+    AiSearchState();
+    AiSearchState(const AiSearchState &other);
+    AiSearchState &operator=(const AiSearchState &other);
+    bool isNull() const { return (aiHand.isEmpty() && groupCount == 0); }
+    AiSearchUndoLog::Mark mark() const;
+    void undo(const AiSearchUndoLog::Mark &mark);
+};
+
+
+
+class AiSearchArena
+{
+    // memory for the short-lived containers made during the search, handed out by bumping through large blocks
+    // nothing is freed on its own (except the last allocation); everything allocated within a `Scope` is given back at once when the scope ends,
+    // so a container made before a scope must not grow within it and be used after it
+    // the blocks are kept for the next scope, and all but the first are freed by `reset()` when the turn has been made
+    // (and by each of the thread pool's search tasks when it ends, so a pool thread's blocks are only freed after each batch of states it searched,
+    // and the turn's thread keeps the blocks grown for one deepening pass through all the later ones: neither is reset between passes)
+    // each thread has its own
+public:
+    struct Mark
+    {
+        int block;
+        size_t used;
+        size_t inUse;
+    };
+    class Scope
+    {
+        // rewinds the thread's arena to where it was when the scope began
+    public:
+        Scope() : _mark(current().mark()) {}
+        ~Scope() { current().rewind(_mark); }
+
+    private:
+        Mark _mark;
+    };
+
+    AiSearchArena() = default;
+    AiSearchArena(const AiSearchArena &) = delete;
+    AiSearchArena &operator=(const AiSearchArena &) = delete;
+    ~AiSearchArena();
+
+    static AiSearchArena &current();
+    void *allocate(size_t bytes, size_t alignment);
+    void deallocate(void *data, size_t bytes);
+    Mark mark() const { return { _block, _used, _inUse }; }
+    void rewind(const Mark &mark) { _block = mark.block; _used = mark.used; _inUse = mark.inUse; }
+    void reset();
+
+private:
+    static constexpr size_t BlockSize = 64 * 1024;
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+    QList<Block> _blocks;
+    int _block = -1;        // the block being allocated from
+    size_t _used = 0;       // bytes used in that block
+    size_t _inUse = 0;      // bytes used in all the blocks up to that one
+
+    void nextBlock(size_t bytes);
+};
+
+template<typename T>
+class AiArenaAllocator
+{
+    // allocates for standard containers from the current thread's `AiSearchArena`
+public:
+    using value_type = T;
+
+    AiArenaAllocator() = default;
+    template<typename U> AiArenaAllocator(const AiArenaAllocator<U> &) {}
+    T *allocate(size_t n) { return static_cast<T *>(AiSearchArena::current().allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *data, size_t n) { AiSearchArena::current().deallocate(data, n * sizeof(T)); }
+    template<typename U> bool operator==(const AiArenaAllocator<U> &) const { return true; }
+    template<typename U> bool operator!=(const AiArenaAllocator<U> &) const { return false; }
+};
+
+template<typename T>
+class AiArenaList : public std::vector<T, AiArenaAllocator<T>>
+{
+    // list allocated from the current thread's `AiSearchArena`, with the `QList` methods the search uses
+public:
+    using std::vector<T, AiArenaAllocator<T>>::vector;
+
+    int count() const { return int(this->size()); }
+    bool isEmpty() const { return this->empty(); }
+    const T &at(int i) const { return (*this)[i]; }
+    const T &first() const { return this->front(); }
+    void append(const T &value) { this->push_back(value); }
+};
+
+
+
+class AiSearchStates : public AiArenaList<AiSearchState>
+{
+
+};
+
+
+
+class AiTurnPlayChooser
+{
+    // chooses one of the turn plays offered to it as they are found, without keeping them all
+    // either at random, equally likely to be any of them, or (when not random) the first one offered
+    // or, given somewhere to collect them, keeps all of them and chooses none
+public:
+    AiTurnPlayChooser(bool random, AiSearchStates *collected = nullptr);
+
+    void offer(const AiSearchState &turnPlay);
+    bool isEmpty() const { return _count == 0; }
+    bool isDone() const { return !_random && _collected == nullptr && _count > 0; }
+    int count() const { return _count; }
+    const AiSearchState &chosen() const { Q_ASSERT(_collected == nullptr); return _chosen; }
+
+private:
+    bool _random;
+    AiSearchStates *_collected;
+    int _count;
+    AiSearchState _chosen;
+};
+
+
+
+class AiSetClassifications
+{
+    // bounded table of how groups have been classified as sets, keyed by their cards, each slot holding the last group stored there
+    // the same unchanged groups are asked about over & over during a search
+    // not shared between threads, each search thread has its own
+public:
+    struct Classification
+    {
+        CardMask group;
+        bool isGoodSet;
+        CardGroup::SetType setType;
+        CardMask freeCards;
+    };
+
+    const Classification *find(const CardMask &group) const { const Classification &entry(_entries[slot(group)]); return (entry.group == group) ? &entry : nullptr; }
+    const Classification &insert(const Classification &classification) { return _entries[slot(classification.group)] = classification; }
+
+private:
+    static constexpr int SizeBits = 12;
+    // (an empty slot holds the classification of the empty group, which is not a set and has no free cards)
+    Classification _entries[1 << SizeBits] = {};
+
+    static int slot(const CardMask &group) { return group.hashKey() >> (64 - SizeBits); }
+};
+
+
+
+class AiFreeCardIndex
+{
+    // the free cards in the groups of one search state, indexed by rank & by suit, and which group each is in
+    // so that only cards which could make a set together need be looked at, rather than every free card in every group
+public:
+    CardMask freeCards;
+    CardMask freeCardsOfRank[13];
+    CardMask freeCardsOfSuit[4];
+    qint8 groupOfCard[CardMask::MaxCards];
+};
+
+
+
+class AiTurnPlan
 {
+    // the best whole turn found so far while planning a turn, a chain of plays which plays as many cards from hand as possible
+public:
+    AiSearchState best;
+    int bestCardsPlayed;
+    int handCount;              // cards in hand at the start of the turn
+    QSet<quint64> plannedFrom;  // hashes of the states already planned from (the same state is often reached by plays in a different order)
+    AiSearchUndoLog *undoLog;   // shared by each state planned from in turn
+    long nodesExpanded;
+    long nodesPruned;
+};
+
+
+
+class AiTranspositionTable
+{
+    // bounded table of search state hashes, each slot holding the last hash stored there
+    // used to remember states which have already been searched and found to have no play
+    // may be used from several search threads at once, without locking: each slot is a single atomic 64-bit hash, always replaced,
+    // so a thread can only miss a hash another thread has just overwritten, which costs a search but never gives a wrong answer
+public:
+    AiTranspositionTable();
+
+    bool contains(quint64 hash) const { return _hashes[slot(hash)].loadRelaxed() == storedHash(hash); }
+    void insert(quint64 hash) { _hashes[slot(hash)].storeRelaxed(storedHash(hash)); }
+    void clear();
+
+private:
+    static constexpr int SizeBits = 15;
+    std::vector<QAtomicInteger<quint64>> _hashes;
 
+    static int slot(quint64 hash) { return hash & ((1 << SizeBits) - 1); }
+    static quint64 storedHash(quint64 hash) { return (hash != 0) ? hash : 1; }
 };
 
 
@@ -34,71 +283,261 @@ public:
     int debugLevel() const { return _debugLevel; }
     void setDebugLevel(int level) { _debugLevel = level; }
 
+    // the strategies the search tries, each profiled separately
+    enum Strategy
+    {
+        CompleteSetsInHandStrategy,
+        CompleteSetsFrom2CardsInHandStrategy,
+        AddToCompleteSetsFrom1CardInHandStrategy,
+        CompleteSetsFrom1CardInHandStrategy,
+        FreeCardMovesStrategy,
+        JoinSetsStrategy,
+        SplitSetsStrategy,
+        RearrangeSetsStrategy,
+        PlanTurnStrategy,
+        StrategyCount
+    };
+    static const char *strategyName(Strategy strategy);
+    struct StrategyStatistics
+    {
+        long calls;
+        long statesGenerated;   // turn plays offered, or rearranged states made
+        qint64 elapsedNs;       // its own time, not counting the strategies it calls on the same thread
+        int maxDepth;           // the most rearrangements of the baize it was called at
+
+        StrategyStatistics &operator+=(const StrategyStatistics &other)
+        {
+            calls += other.calls;
+            statesGenerated += other.statesGenerated;
+            elapsedNs += other.elapsedNs;
+            maxDepth = qMax(maxDepth, other.maxDepth);
+            return *this;
+        }
+    };
+
     struct Statistics
     {
         long isGoodSetCalls;
+        long transpositionTableHits;
+        long transpositionTableMisses;
         long aiModelStatesCreated;
+        long setClassificationHits;
+        long setClassificationMisses;
+        // `CardGroup`'s own classification cache, used outside the search, counted over the turn on the thread which makes it
+        long groupClassificationHits;
+        long groupClassificationMisses;
+        long newSetCandidates;
+        // the search arena's allocations, the blocks it allocated itself to hand them out from, and the most it had in use at once on any one thread
+        long arenaAllocations;
+        long arenaBytesAllocated;
+        long arenaBlocksAllocated;
+        long arenaPeakBytes;
+        // the turn planning totals, only set by the thread which makes the turn
+        long planNodesExpanded;
+        long planNodesPruned;
+        int planCardsPlayed;
+        // whether the "no play possible" filter was checked & found there could be no play (so the search was skipped), and how long checking took
+        // and, when measuring what it saves, how long the skipped search took & how many rearranged states it searched
+        long noPlayFilterChecks;
+        long noPlayFilterHits;
+        qint64 noPlayFilterNs;
+        qint64 noPlayFilterSavedNs;
+        long noPlayFilterSavedNodes;
+        // the search totals, only set by the thread which makes the turn
+        long searchNodes;
+        long searchNodesToSolution;
+        int searchDepth;
+        qint64 searchElapsedMs;
+        bool searchTimeLimitHit;
+        bool searchNodeLimitHit;
+        // the strategies, only counted when profiling
+        StrategyStatistics strategies[StrategyCount];
+        // the strategy which found the play found by the search (before any planning), and after how many rearrangements (-1 for no play)
+        int chosenStrategy;
+        int chosenDepth;
+
+        Statistics &operator+=(const Statistics &other)
+        {
+            // every field but the chosen strategy & depth, which are those of the one play found, and so are not combined
+            // (a field added above must be added here too)
+            isGoodSetCalls += other.isGoodSetCalls;
+            transpositionTableHits += other.transpositionTableHits;
+            transpositionTableMisses += other.transpositionTableMisses;
+            aiModelStatesCreated += other.aiModelStatesCreated;
+            setClassificationHits += other.setClassificationHits;
+            setClassificationMisses += other.setClassificationMisses;
+            groupClassificationHits += other.groupClassificationHits;
+            groupClassificationMisses += other.groupClassificationMisses;
+            newSetCandidates += other.newSetCandidates;
+            arenaAllocations += other.arenaAllocations;
+            arenaBytesAllocated += other.arenaBytesAllocated;
+            arenaBlocksAllocated += other.arenaBlocksAllocated;
+            arenaPeakBytes = qMax(arenaPeakBytes, other.arenaPeakBytes);
+            planNodesExpanded += other.planNodesExpanded;
+            planNodesPruned += other.planNodesPruned;
+            planCardsPlayed += other.planCardsPlayed;
+            noPlayFilterChecks += other.noPlayFilterChecks;
+            noPlayFilterHits += other.noPlayFilterHits;
+            noPlayFilterNs += other.noPlayFilterNs;
+            noPlayFilterSavedNs += other.noPlayFilterSavedNs;
+            noPlayFilterSavedNodes += other.noPlayFilterSavedNodes;
+            searchNodes += other.searchNodes;
+            searchNodesToSolution += other.searchNodesToSolution;
+            searchDepth = qMax(searchDepth, other.searchDepth);
+            searchElapsedMs += other.searchElapsedMs;
+            searchTimeLimitHit = searchTimeLimitHit || other.searchTimeLimitHit;
+            searchNodeLimitHit = searchNodeLimitHit || other.searchNodeLimitHit;
+            for (int strategy = 0; strategy < StrategyCount; strategy++)
+                strategies[strategy] += other.strategies[strategy];
+            return *this;
+        }
+    };
+    // each search thread counts into its own statistics, which are added into the calling thread's when it finishes
+    static thread_local Statistics statistics;
+
+    // each rearrangement adds at most 3 new groups, so this many must still fit in `AiSearchState::MaxGroups`
+    static constexpr int MaxRearrangeDepth = 3;
+    // a play adds at most 1 new group, so a position with more groups than this cannot be searched,
+    // leaving room in `AiSearchState::MaxGroups` for the groups the deepest search can add
+    static constexpr int MaxSearchGroups = AiSearchState::MaxGroups - 3 * (MaxRearrangeDepth + 1);
+    // the most groups a legal position's baize can have: the 4 initial free cards each on its own,
+    // and sets of at least 3 cards from the rest but 1 (the player's hand is never empty during a deal)
+    static constexpr int MaxBaizeGroups = 4 + (CardMask::MaxCards - 4 - 1) / 3;
+    static_assert(MaxSearchGroups >= MaxBaizeGroups, "every legal position must fit in the search state");
+    // the most ways of moving a broken set's cards onto other sets offered for one broken set
+    static constexpr int MaxBrokenSetRearrangements = 64;
+    struct SearchSettings
+    {
+        bool deterministic;     // search rearranged states one after another, exactly as reproducible from the random number seed
+        int maxThreads;         // when not deterministic, how many threads search rearranged states in parallel (0 for all)
+        int maxRearrangeDepth;  // how many rearrangements of the baize to search through, deepening one at a time (up to `MaxRearrangeDepth`)
+        int timeLimitMs;        // stop searching after this long (0 for no limit)
+        int nodeLimit;          // stop searching after this many rearranged states (0 for no limit)
+        bool orderRearrangements;   // make all the rearrangements of a state first, and search the most promising first, else in the order made
+                                    // (only the rearrangements which are rearranged again are ordered, so this has no effect unless `maxRearrangeDepth` is 2 or more)
+        bool randomTurnPlay;    // choose at random from all the turn plays found by a stage of the search, else take the first found
+        bool indexFreeCards;    // look for new sets only among free cards indexed by rank & suit, else among every group's free cards (for comparison)
+        bool noPlayFilter;      // before searching, check whether any card in hand could make a set at all with the cards in hand & on the baize, and if none could skip the search
+        bool measureNoPlayFilter;   // when the filter skips the search, make it anyway (it finds no play), to count what skipping it saves (for measuring only)
+        bool collapseDuplicateCards;    // treat the 2 packs' copies of a card alike: try cards in hand once per face, and hash states by faces, not cards
+        bool planTurn;          // plan the whole turn, chaining further plays onto the play found to play as many cards from hand as possible
+        int planNodeLimit;      // stop planning after expanding this many states (0 for no limit), as well as at `timeLimitMs`
+        bool profileStrategies; // count the calls, states generated, time & depth of each strategy
+        QString profileFilePath;    // when profiling, append each turn's profile to this file, as one line of JSON (empty for none)
+        int slowTurnMs;         // a turn taking at least this long is slow (0 for no limit)
+        long slowTurnStates;    // a turn creating at least this many search states is slow (0 for no limit)
+        QString slowPositionsPath;  // write each slow turn's position to this directory, as a `.sav` file with the turn's statistics (empty for none)
     };
-    static Statistics statistics;
+    const SearchSettings &searchSettings() const { return _searchSettings; }
+    void setSearchSettings(const SearchSettings &settings) { _searchSettings = settings; }
 
-    LogicalModel *logicalModel;
+    void cancelTurn(int turnNumber);
 
 private:
     int _debugLevel;
-    const CardDeck &cardDeck() const { return logicalModel->cardDeck; }
-    int activePlayer() const { return logicalModel->activePlayer; }
-    const CardGroups &cardGroups() const { return logicalModel->cardGroups; }
-    const CardHands &hands() const { return logicalModel->hands; }
+    SearchSettings _searchSettings;
+    LogicalModelSnapshot _snapshot;
+    int _turnNumber;
+    QAtomicInt _cancelledTurnNumber;
+    CardMask _initialFreeCards;
+    CardMask _searchCards;
+    mutable AiTranspositionTable _noPlayStates;
+    mutable QAtomicInt _searchCancelled;
+    int _searchMaxDepth;
+    QElapsedTimer _searchTimer;
+    mutable QAtomicInt _searchNodes;
+    enum SearchBudget { SearchBudgetLeft, SearchTimeLimitHit, SearchNodeLimitHit };
+    mutable QAtomicInt _searchBudgetExhausted;
+    const QList<const Card *> &cards() const { return _snapshot.cards(); }
+    int activePlayer() const { return _snapshot.activePlayer(); }
+    const CardGroups &cardGroups() const { return _snapshot.cardGroups(); }
+    const CardHands &hands() const { return _snapshot.hands(); }
     const CardHand &aiHand() const;
 
     void resetStatistics();
     void showStatistics();
-    QList<const Card *> freeCardsInGroup(const CardGroup &group) const;
-    QList<const Card *> findAllFreeCardsInGroups(const CardGroups &groups) const;
-    void removeFirstCardRankSet(CardHand &hand, CardGroup &rankSet) const;
-    void removeFirstCardRunSet(CardHand &hand, CardGroup &runSet) const;
-    void removeFirstCardGenerateAll2CardPartialRunSets(CardHand &hand, CardGroups &runSets) const;
-    CardGroups pivotSets(CardGroups existingSets) const;
-    void verifyChangedState(AiModelState initialState, AiModelState newState) const;
-    void addNewSet(AiModelState &state, const CardGroup &newSet) const;
-    void modifySet(AiModelState &state, const CardGroup &modifiedSet) const;
-    void clearSet(AiModelState &state, const CardGroup &existingSet) const;
-    void removeCardFromHand(AiModelState &state, const Card *card) const;
-    void removeCardsFromHand(AiModelState &state, const QList<const Card *> &cards) const;
-    void removeCardFromGroups(AiModelState &state, const Card *card) const;
-    void removeCardsFromGroups(AiModelState &state, const QList<const Card *> &cards) const;
-    void removeCardsFromOneGroup(AiModelState &state, const QList<const Card *> &cards) const;
-    AiModelStates findAllCompleteRankSetsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllCompleteRunSetsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllPartialRankSetsFrom2CardsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllPartialRunSetsFrom2CardsInHand(const AiModelState &initialState) const;
-    AiModelStates rearrangeBrokenSetOnBaizeToOtherSets(const AiModelState &initialState, const CardGroup &brokenSet) const;
-    AiModelStates completePartialRankSetFrom1CardOnBaizeWithRearrangement(const AiModelState &initialState) const;
-    AiModelStates completePartialRunSetFrom1CardOnBaizeWithRearrangement(const AiModelState &initialState) const;
-    AiModelStates completePartialRankSetFrom1CardOnBaize(const AiModelState &initialState) const;
-    AiModelStates completePartialRunSetFrom1CardOnBaize(const AiModelState &initialState) const;
-    AiModelStates findAllCompleteRankSetsFrom2CardsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllCompleteRunSetsFrom2CardsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllAddToSetsFrom1CardInHand(const AiModelState &initialState) const;
-    AiModelStates findAllCompleteSetsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllCompleteSetsFrom2CardsInHand(const AiModelState &initialState) const;
-    AiModelStates findAllAddToCompleteSetsFrom1CardInHand(const AiModelState &initialState) const;
-    AiModelStates findAllCompleteSetsFrom1CardInHand(const AiModelState &initialState) const;
-    AiModelStates findAllMakeNewSetsFrom1CardInHand(const AiModelState &initialState) const;
-    AiModelState findOneSimpleTurnPlay(const AiModelState &initialState, int depth) const;
-    AiModelState searchEquivalent1FreeCardMoveStates(const AiModelState &initialState, int depth) const;
-    AiModelState searchEquivalent1JoinSetsStates(const AiModelState &initialState, int depth) const;
-    AiModelState searchEquivalentInitialStates(const AiModelState &initialState, int depth) const;
-    AiModelState searchEquivalent1SplitSetsStates(const AiModelState &initialState, int depth) const;
-    AiModelState searchEquivalent3RearrangeSetsStates(const AiModelState &initialState, int depth) const;
-    AiModelState findOneComplexTurnPlay(const AiModelState &initialState, int depth) const;
-    AiModelState findOneTurnPlay() const;
+    void writeStrategyProfile(int turnNumber, bool turnCancelled) const;
+    void writeSlowPosition(int turnNumber, qint64 elapsedNs) const;
+    quint64 handCardHash(const CardMask &hand, int card) const;
+    quint64 groupHash(const CardMask &group) const;
+    CardMask handCardsToTry(const CardMask &hand) const { return _searchSettings.collapseDuplicateCards ? hand.distinctFaces() : hand; }
+    quint64 stateHash(const AiSearchState &state) const;
+    bool isInitialCardGroup(const CardMask &group) const;
+    const AiSetClassifications::Classification &classifySet(const CardMask &group) const;
+    CardMask freeCardsInGroup(const CardMask &group) const;
+    CardMask findAllFreeCardsInGroups(const AiSearchState &state) const;
+    AiFreeCardIndex indexFreeCardsInGroups(const AiSearchState &state) const;
+    void removeFirstCardRankSet(CardMask &hand, CardMask &rankSet) const;
+    void removeFirstCardRunSet(CardMask &hand, CardMask &runSet) const;
+    void removeFirstCardGenerateAll2CardPartialRunSets(CardMask &hand, AiArenaList<CardMask> &runSets) const;
+    AiArenaList<CardMask> pivotSets(const AiArenaList<CardMask> &existingSets) const;
+    void verifyChangedState(const AiSearchState &newState) const;
+    void addNewSet(AiSearchState &state, const CardMask &newSet) const;
+    void modifySet(AiSearchState &state, int index, const CardMask &modifiedSet) const;
+    void clearSet(AiSearchState &state, int index) const;
+    void removeCardFromHand(AiSearchState &state, int card) const;
+    void removeCardsFromHand(AiSearchState &state, const CardMask &cards) const;
+    void removeCardFromGroups(AiSearchState &state, int card) const;
+    void removeCardsFromGroups(AiSearchState &state, const CardMask &cards) const;
+    void removeCardsFromOneGroup(AiSearchState &state, const CardMask &cards) const;
+    void findAllCompleteRankSetsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllCompleteRunSetsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    AiArenaList<CardMask> findAllPartialRankSetsFrom2CardsInHand(const AiSearchState &initialState) const;
+    AiArenaList<CardMask> findAllPartialRunSetsFrom2CardsInHand(const AiSearchState &initialState) const;
+    void rearrangeBrokenSetOnBaizeToOtherSets(AiSearchState &state, int brokenSetIndex, AiTurnPlayChooser &turnPlays) const;
+    void completePartialRankSetFrom1CardOnBaizeWithRearrangement(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void completePartialRunSetFrom1CardOnBaizeWithRearrangement(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void completePartialRankSetFrom1CardOnBaize(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void completePartialRunSetFrom1CardOnBaize(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllCompleteRankSetsFrom2CardsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllCompleteRunSetsFrom2CardsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllAddToSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllCompleteSetsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllCompleteSetsFrom2CardsInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllAddToCompleteSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllCompleteSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    void findAllMakeNewSetsFrom1CardInHand(AiSearchState &state, AiTurnPlayChooser &turnPlays) const;
+    AiSearchState findOneSimpleTurnPlay(AiSearchState &state, int depth) const;
+    bool searchBudgetExhausted() const;
+    bool turnCancelled() const { return _turnNumber <= _cancelledTurnNumber.loadRelaxed(); }
+    bool searchCancelled() const { return _searchCancelled.loadRelaxed() != 0 || searchBudgetExhausted() || turnCancelled(); }
+    AiSearchState searchEquivalentState(AiSearchState &equivalentState, int depth) const;
+    AiSearchState searchEquivalentStatesInParallel(const AiSearchStates &equivalentStates, int depth) const;
+    AiSearchState searchRearrangedState(AiSearchState &state, int depth, AiSearchStates *deferredStates) const;
+    AiSearchState searchEquivalent1FreeCardMoveStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const;
+    AiSearchState searchEquivalent1JoinSetsStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const;
+    int scoreRearrangedState(const AiSearchState &state) const;
+    void orderRearrangedStates(AiSearchStates &states) const;
+    AiSearchState searchEquivalentInitialStates(AiSearchState &state, int depth) const;
+    AiSearchState searchEquivalent1SplitSetsStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const;
+    AiSearchState searchEquivalent3RearrangeSetsStates(AiSearchState &state, int depth, AiSearchStates *deferredStates) const;
+    AiSearchState findOneComplexTurnPlay(AiSearchState &state, int depth) const;
+    AiSearchState findOneRearrangedTurnPlay(AiSearchState &state);
+    void findAllSimpleTurnPlays(AiSearchState &state, AiSearchStates &turnPlays) const;
+    bool couldMakeSetWith(int card, const CardMask &cards, const CardMask &partners) const;
+    int countHandCardsWhichCouldJoinSets(const AiSearchState &state) const;
+    bool anyHandCardCouldBePlayed(const AiSearchState &state) const;
+    bool planBudgetExhausted(const AiTurnPlan &plan) const;
+    void planTurnThroughPlays(AiSearchStates &turnPlays, AiTurnPlan &plan);
+    void planTurnFrom(AiSearchState &state, AiTurnPlan &plan);
+    AiSearchState planTurn(AiSearchState &state, const AiSearchState &firstTurnPlay);
+    AiSearchState initialSearchState() const;
+    AiModelState turnPlayFromSearchState(const AiSearchState &state) const;
+    AiSearchState beginSearch();
+    AiModelState findOneTurnPlay();
+
+    // (the microbenchmark times the search's generators one at a time, on positions of its own)
+    friend class AiModelMicrobenchmark;
 
 public slots:
-    void makeTurn();
+    void makeTurn(const LogicalModelSnapshot &snapshot, int turnNumber);
 
 signals:
-    void makeTurnPlay(AiModelState turnPlay);
+    void makeTurnProgress(int turnNumber, int searchDepth, int searchNodes);
+    void makeTurnPlay(int turnNumber, AiModelState turnPlay);
 };
 
+// (passed between the UI's thread & the AI's by queued connections)
+Q_DECLARE_METATYPE(AiModelState)
+
 #endif // AIMODEL_H
@@ -30,12 +30,12 @@ QString Card::toString() const
     return str;
 }
 
-/*static*/ bool Card::compareForSortBySuit(const Card *cardA, const Card *cardB)
+/*static*/ bool Card::compareIdsForSortBySuit(int idA, int idB)
 {
     // sort order: Diamonds, Clubs, Hearts, Spades
     //             then rank in descending order
-    int suitA(cardA->suit()), suitB(cardB->suit());
-    int rankA(cardA->rank()), rankB(cardB->rank());
+    int suitA(suitOf(idA)), suitB(suitOf(idB));
+    int rankA(rankOf(idA)), rankB(rankOf(idB));
     if (suitA == 1)
         suitA = -1;
     if (suitB == 1)
@@ -45,3 +45,8 @@ QString Card::toString() const
     int valueA(suitA * 13 + rankA), valueB(suitB * 13 + rankB);
     return (valueA < valueB);
 }
+
+/*static*/ bool Card::compareForSortBySuit(const Card *cardA, const Card *cardB)
+{
+    return compareIdsForSortBySuit(cardA->id, cardB->id);
+}
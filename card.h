@@ -17,10 +17,14 @@ private:
 public:
     Card(int id);
 
-    inline int pack() const { return id / 52; }
-    inline int suit() const { return id % 52 % 4; }
-    inline int rank() const { return id % 52 / 4; }
+    static inline int packOf(int id) { return id / 52; }
+    static inline int suitOf(int id) { return id % 52 % 4; }
+    static inline int rankOf(int id) { return id % 52 / 4; }
+    inline int pack() const { return packOf(id); }
+    inline int suit() const { return suitOf(id); }
+    inline int rank() const { return rankOf(id); }
     QString toString() const;
+    static bool compareIdsForSortBySuit(int idA, int idB);
     static bool compareForSortBySuit(const Card *cardA, const Card *cardB);
 };
 
@@ -1,29 +1,47 @@
 #include <QDebug>
 
 #include "cardgroup.h"
+#include "cardsettables.h"
 
-/*static*/ long CardGroup::_nextUniqueId = 1L;
+/*static*/ QAtomicInteger<long> CardGroup::_nextUniqueId = 1L;
+/*static*/ thread_local long CardGroup::_classificationHits = 0L;
+/*static*/ thread_local long CardGroup::_classificationMisses = 0L;
 
 CardGroup::CardGroup()
 {
-    this->_uniqueId = _nextUniqueId++;
+    this->_uniqueId = _nextUniqueId.fetchAndAddRelaxed(1);
     valueChanged();
 }
 
 CardGroup::CardGroup(std::initializer_list<const Card *> args) :
     QList<const Card *>(args)
 {
-    this->_uniqueId = _nextUniqueId++;
+    this->_uniqueId = _nextUniqueId.fetchAndAddRelaxed(1);
     valueChanged();
 }
 
-/*static*/ void CardGroup::resetNextUniqueId()
+CardGroup::CardGroup(const CardGroup &other) :
+    QList<const Card *>(other),
+    _uniqueId(other._uniqueId)
 {
-    CardGroup::_nextUniqueId = 1L;
+    // the cards are shared (copy-on-write), the classification is not: the copy works it out again when first asked for
+    // so that a copy made for another thread (as `LogicalModelSnapshot` makes) shares nothing mutable with the group it was copied from
+    valueChanged();
+}
+
+CardGroup &CardGroup::operator=(const CardGroup &other)
+{
+    // as the copy constructor
+    QList<const Card *>::operator=(other);
+    _uniqueId = other._uniqueId;
+    valueChanged();
+    return *this;
 }
 
 void CardGroup::valueChanged()
 {
+    // the cards have changed, so they need classifying again
+    _classification.isClassified = false;
 #ifdef QT_DEBUG
     this->_debugStr = toString();
 #endif
@@ -41,15 +59,14 @@ QString CardGroup::toString() const
     return str;
 }
 
-int CardGroup::rankDifference(int rank0, int rank1) const
+/*static*/ int CardGroup::rankDifference(int rank0, int rank1)
 {
     // return the difference in rank *from* rank1 *to* rank0, i.e. rank0 - rank1 (a la strcmp())
     // this can be positive (rank0 > rank1) or negative (rank0 < rank1) or zero (rank0 == rank1)
     // this deals with the "wraparound" which occurs at an Ace, which can be high or low (like 2-A-K)
     // we meassure the distance in both directions and return the number (positive or negative) whose *absolute* value is smallest
-    int diff0(rank0 - rank1);
-    int diff1((diff0 > 0) ? diff0 - 13 : diff0 + 13);
-    return (qAbs(diff0) < qAbs(diff1)) ? diff0 : diff1;
+    // (looked up from a table made at compile time)
+    return CardSetTables::rankDifference(rank0, rank1);
 }
 
 void CardGroup::rearrangeForSets()
@@ -99,32 +116,78 @@ void CardGroup::rearrangeForSets()
     valueChanged();
 }
 
-bool CardGroup::isGoodRankSet() const
+const CardGroup::Classification &CardGroup::classification() const
+{
+    if (_classification.isClassified)
+    {
+        _classificationHits++;
+        return _classification;
+    }
+    _classificationMisses++;
+    _classification.isGoodSet = true;
+    if (classifyAsRankSet())
+        _classification.setType = SetType::RankSet;
+    else if (classifyAsRunSet())
+        _classification.setType = SetType::RunSet;
+    else
+        _classification.isGoodSet = false;
+    _classification.isClassified = true;
+    return _classification;
+}
+
+bool CardGroup::classifyAsRankSet() const
 {
     if (count() < 3)
         return false;
     // check for same rank (different suits)
-    QSet<int> suits;
+    // (the suits seen so far are held as a 4-bit mask)
+    int rank0 = at(0)->rank();
+    int suits = 0;
     for (const Card* card : *this)
-        if (card->rank() != at(0)->rank() || suits.contains(card->suit()))
+    {
+        int suit = 1 << card->suit();
+        if (card->rank() != rank0 || (suits & suit) != 0)
             return false;
-        else
-            suits.insert(card->suit());
+        suits |= suit;
+    }
     return true;
 }
 
-bool CardGroup::isGoodRunSet() const
+bool CardGroup::classifyAsRunSet() const
 {
     if (count() < 3)
         return false;
     // check for sequential cards in same suit
     // (assumes ordered as per `rearrangeForSets`)
+    // first check that the ranks make one unbroken run at all, then that they are in order
+    int suit0 = at(0)->suit();
+    quint32 ranks = 0;
+    for (const Card* card : *this)
+    {
+        if (card->suit() != suit0)
+            return false;
+        ranks |= 1u << card->rank();
+    }
+    if (!CardSetTables::isRunOfRanks(ranks))
+        return false;
     for (int i = 1; i < count(); i++)
-        if (at(i)->suit() != at(i - 1)->suit() || rankDifference(at(i)->rank(), at(i - 1)->rank()) != -1)
+        if (CardSetTables::rankDifference(at(i)->rank(), at(i - 1)->rank()) != -1)
             return false;
     return true;
 }
 
+bool CardGroup::isGoodRankSet() const
+{
+    const Classification &classification(this->classification());
+    return classification.isGoodSet && classification.setType == SetType::RankSet;
+}
+
+bool CardGroup::isGoodRunSet() const
+{
+    const Classification &classification(this->classification());
+    return classification.isGoodSet && classification.setType == SetType::RunSet;
+}
+
 bool CardGroup::isGoodSetOfType(SetType setTypeWanted) const
 {
     return (setTypeWanted == SetType::RankSet) ? isGoodRankSet() : (setTypeWanted == SetType::RunSet) ? isGoodRunSet() : false;
@@ -132,17 +195,10 @@ bool CardGroup::isGoodSetOfType(SetType setTypeWanted) const
 
 bool CardGroup::isGoodSet(SetType &setType) const
 {
-    if (isGoodRankSet())
-    {
-        setType = SetType::RankSet;
-        return true;
-    }
-    else if (isGoodRunSet())
-    {
-        setType = SetType::RunSet;
-        return true;
-    }
-    return false;
+    const Classification &classification(this->classification());
+    if (classification.isGoodSet)
+        setType = classification.setType;
+    return classification.isGoodSet;
 }
 
 bool CardGroup::isGoodSet() const
@@ -184,11 +240,11 @@ QString CardGroups::toString() const
 
 void CardGroups::clearGroups()
 {
+    // (the unique ids go on counting up, not from 1 again: models on other threads, dealing their own deals, are taking ids too)
     clear();
-    CardGroup::resetNextUniqueId();
 }
 
-int CardGroups::findCardGroupByUniqueId(int uniqueId) const
+int CardGroups::findCardGroupByUniqueId(long uniqueId) const
 {
     for (int i = 0; i < count(); i++)
         if (at(i).uniqueId() == uniqueId)
@@ -1,6 +1,7 @@
 #ifndef CARDGROUP_H
 #define CARDGROUP_H
 
+#include <QAtomicInteger>
 #include <QJsonArray>
 #include <QList>
 
@@ -9,24 +10,50 @@
 
 class CardGroup : public QList<const Card *>
 {
+public:
+    enum SetType { RankSet, RunSet };
+
 private:
-    static long _nextUniqueId;
+    // (groups are created on the AI's thread as well as the UI's)
+    static QAtomicInteger<long> _nextUniqueId;
     long _uniqueId;
 #ifdef QT_DEBUG
     QString _debugStr;
 #endif
 
+    // what sort of set the cards make, worked out when first asked for and kept until the cards change
+    // the cache is written by `const` methods without any locking, so it is NOT thread-safe:
+    // a group must not be asked for this from more than one thread at a time, even though it is `const`
+    // (which is why `LogicalModelSnapshot` copies each group for the AI's thread rather than sharing the model's)
+    // there are no free-card positions kept here: the AI search works on `CardMask`s, and keeps those in `AiModel::classifySet()`
+    // a copy of a group does not copy this, it starts unclassified (see the copy constructor)
+    struct Classification
+    {
+        bool isClassified;
+        bool isGoodSet;
+        SetType setType;
+    };
+    mutable Classification _classification;
+    // how often asking for this found it already worked out, and how often it had to be, counted separately on each thread
+    static thread_local long _classificationHits;
+    static thread_local long _classificationMisses;
+
     void valueChanged();
+    const Classification &classification() const;
+    bool classifyAsRankSet() const;
+    bool classifyAsRunSet() const;
 
 public:
     CardGroup();
     CardGroup(std::initializer_list<const Card *> args);
+    CardGroup(const CardGroup &other);
+    CardGroup &operator=(const CardGroup &other);
 
-    static void resetNextUniqueId();
     long uniqueId() const { return _uniqueId; }
-    enum SetType { RankSet, RunSet };
+    static long classificationHits() { return _classificationHits; }
+    static long classificationMisses() { return _classificationMisses; }
     QString toString() const;
-    int rankDifference(int rank0, int rank1) const;
+    static int rankDifference(int rank0, int rank1);
     void rearrangeForSets();
     bool isGoodRankSet() const;
     bool isGoodRunSet() const;
@@ -35,7 +62,7 @@ public:
     bool isGoodSet() const;
     void removeCards(const QList<const Card *> &cards);
 
-#ifdef QT_DEBUG
+    // all changes to the cards go through these, so that `valueChanged()` is always called
 public:
     QList<const Card *> &operator=(QList<const Card *> &&other) { QList<const Card *> &res(QList<const Card *>::operator=(other)); valueChanged(); return res; }
     QList<const Card *> &operator=(const QList<const Card *> &other) { QList<const Card *> &res(QList<const Card *>::operator=(other)); valueChanged(); return res; }
@@ -56,8 +83,38 @@ public:
     const Card *takeFirst() { const Card *res = QList<const Card *>::takeFirst(); valueChanged(); return res; }
     const Card *takeLast() { const Card *res = QList<const Card *>::takeLast(); valueChanged(); return res; }
 
+    // the cards can only be read through these, which hide `QList`'s non-const overloads
+    const_iterator begin() const { return QList<const Card *>::begin(); }
+    const_iterator end() const { return QList<const Card *>::end(); }
+    const_reverse_iterator rbegin() const { return QList<const Card *>::rbegin(); }
+    const_reverse_iterator rend() const { return QList<const Card *>::rend(); }
+    const Card *first() const { return QList<const Card *>::first(); }
+    const Card *last() const { return QList<const Card *>::last(); }
+    const Card *front() const { return QList<const Card *>::front(); }
+    const Card *back() const { return QList<const Card *>::back(); }
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    const Card *const *data() const { return QList<const Card *>::data(); }
+#endif
+
+    // and the other changes are not allowed
 private:
     using QList<const Card *>::operator[];
+    using QList<const Card *>::operator<<;
+    using QList<const Card *>::operator+=;
+    using QList<const Card *>::erase;
+    using QList<const Card *>::pop_back;
+    using QList<const Card *>::pop_front;
+    using QList<const Card *>::push_back;
+    using QList<const Card *>::push_front;
+    using QList<const Card *>::swap;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    // (Qt 5's `QList` has none of these)
+    using QList<const Card *>::emplace;
+    using QList<const Card *>::emplaceBack;
+    using QList<const Card *>::fill;
+    using QList<const Card *>::remove;
+    using QList<const Card *>::removeIf;
+    using QList<const Card *>::resize;
 #endif
 };
 
@@ -71,7 +128,7 @@ public:
 
     QString toString() const;
     void clearGroups();
-    int findCardGroupByUniqueId(int uniqueId) const;
+    int findCardGroupByUniqueId(long uniqueId) const;
     int findCardInGroups(const Card *card) const;
     int removeCardFromGroups(const Card *card);
     void removeEmptyGroups();
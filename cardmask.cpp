@@ -0,0 +1,108 @@
+#include "cardmask.h"
+#include "cardsettables.h"
+
+CardMask::CardMask(const QList<const Card *> &cards)
+    : _lo(0), _hi(0)
+{
+    for (const Card *card : cards)
+        insert(card->id);
+}
+
+/*static*/ quint32 CardMask::ranksInSuit(quint64 faces, int suit)
+{
+    // return a 13-bit mask of the ranks present in `suit`
+    quint32 ranks = 0;
+    for (quint64 suitFaces = (faces >> suit) & SuitFaceBits; suitFaces != 0; suitFaces &= suitFaces - 1)
+        ranks |= 1 << (qCountTrailingZeroBits(suitFaces) / 4);
+    return ranks;
+}
+
+int CardMask::findCard(int suit, int rank) const
+{
+    // return the id of the card of `suit` & `rank` from either pack, or -1 if not present
+    int id = rank * 4 + suit;
+    if (contains(id))
+        return id;
+    else if (contains(id + 52))
+        return id + 52;
+    return -1;
+}
+
+bool CardMask::isGoodRankSet() const
+{
+    int cardCount = count();
+    if (cardCount < 3)
+        return false;
+    // check for same rank (different suits)
+    if (hasDuplicateFaces())
+        return false;
+    quint64 faces = faceBits();
+    int rank = qCountTrailingZeroBits(faces) / 4;
+    return (faces & ~(Q_UINT64_C(0xF) << (rank * 4))) == 0;
+}
+
+bool CardMask::isGoodRunSet() const
+{
+    int cardCount = count();
+    if (cardCount < 3)
+        return false;
+    // check for sequential cards in same suit
+    if (hasDuplicateFaces())
+        return false;
+    quint64 faces = faceBits();
+    int suit = qCountTrailingZeroBits(faces) % 4;
+    if ((faces & ~(SuitFaceBits << suit)) != 0)
+        return false;
+    // the ranks must be sequential (allowing for the "wraparound" at an Ace)
+    return CardSetTables::isRunOfRanks(ranksInSuit(faces, suit));
+}
+
+bool CardMask::isGoodSetOfType(CardGroup::SetType setTypeWanted) const
+{
+    return (setTypeWanted == CardGroup::RankSet) ? isGoodRankSet() : (setTypeWanted == CardGroup::RunSet) ? isGoodRunSet() : false;
+}
+
+bool CardMask::isGoodSet(CardGroup::SetType &setType) const
+{
+    if (isGoodRankSet())
+    {
+        setType = CardGroup::RankSet;
+        return true;
+    }
+    else if (isGoodRunSet())
+    {
+        setType = CardGroup::RunSet;
+        return true;
+    }
+    return false;
+}
+
+bool CardMask::isGoodSet() const
+{
+    CardGroup::SetType setType;
+    return isGoodSet(setType);
+}
+
+int CardMask::arrangedCardIds(int ids[MaxCards]) const
+{
+    // fill `ids` with the cards in the order `CardGroup::rearrangeForSets()` would arrange them, and return how many
+    // a run set goes from its highest rank downward (allowing for the "wraparound" at an Ace)
+    // anything else is left in ascending id order
+    int cardCount = 0;
+    if (!isGoodRunSet())
+    {
+        for (int id : *this)
+            ids[cardCount++] = id;
+        return cardCount;
+    }
+    quint64 faces = faceBits();
+    int suit = qCountTrailingZeroBits(faces) % 4;
+    quint32 ranks = ranksInSuit(faces, suit);
+    int rank = CardSetTables::runTopRank(ranks);
+    for (int i = count(); i > 0; i--)
+    {
+        ids[cardCount++] = findCard(suit, rank);
+        rank = (rank + 12) % 13;
+    }
+    return cardCount;
+}
@@ -0,0 +1,80 @@
+#ifndef CARDMASK_H
+#define CARDMASK_H
+
+#include <QList>
+#include <QtAlgorithms>
+
+#include "card.h"
+#include "cardgroup.h"
+
+class CardMask
+{
+    // a set of cards held as a 104-bit mask, one bit per card id
+    // bits 0-63 are held in `_lo`, bits 64-103 in `_hi`
+    // within each pack of 52 cards, card id `rank * 4 + suit` is the "face" of the card
+
+private:
+    quint64 _lo, _hi;
+
+    static constexpr quint64 FaceBits = (Q_UINT64_C(1) << 52) - 1;
+    static constexpr quint64 SuitFaceBits = Q_UINT64_C(0x1111111111111);
+
+    constexpr CardMask(quint64 lo, quint64 hi) : _lo(lo), _hi(hi) {}
+    quint64 faceBits() const { return (_lo & FaceBits) | (_lo >> 52) | (_hi << 12); }
+    bool hasDuplicateFaces() const { return ((_lo & FaceBits) & ((_lo >> 52) | (_hi << 12))) != 0; }
+    static quint32 ranksInSuit(quint64 faces, int suit);
+
+public:
+    static constexpr int MaxCards = 104;
+
+    constexpr CardMask() : _lo(0), _hi(0) {}
+    explicit CardMask(const QList<const Card *> &cards);
+
+    static CardMask fromId(int id) { CardMask mask; mask.insert(id); return mask; }
+    bool isEmpty() const { return (_lo | _hi) == 0; }
+    int count() const { return qPopulationCount(_lo) + qPopulationCount(_hi); }
+    bool contains(int id) const { return (id < 64) ? (_lo >> id) & 1 : (_hi >> (id - 64)) & 1; }
+    bool contains(const CardMask &other) const { return (other._lo & ~_lo) == 0 && (other._hi & ~_hi) == 0; }
+    bool intersects(const CardMask &other) const { return (_lo & other._lo) != 0 || (_hi & other._hi) != 0; }
+    int first() const { return (_lo != 0) ? qCountTrailingZeroBits(_lo) : (_hi != 0) ? 64 + qCountTrailingZeroBits(_hi) : -1; }
+    int findCard(int suit, int rank) const;
+    // one card of each face in the mask, the first pack's where it holds both
+    CardMask distinctFaces() const { quint64 faces0 = _lo & FaceBits, faces1 = faceBits() & ~faces0; return CardMask(faces0 | (faces1 << 52), faces1 >> 12); }
+    void insert(int id) { if (id < 64) _lo |= Q_UINT64_C(1) << id; else _hi |= Q_UINT64_C(1) << (id - 64); }
+    void remove(int id) { if (id < 64) _lo &= ~(Q_UINT64_C(1) << id); else _hi &= ~(Q_UINT64_C(1) << (id - 64)); }
+
+    CardMask operator|(const CardMask &other) const { return CardMask(_lo | other._lo, _hi | other._hi); }
+    CardMask operator&(const CardMask &other) const { return CardMask(_lo & other._lo, _hi & other._hi); }
+    CardMask operator-(const CardMask &other) const { return CardMask(_lo & ~other._lo, _hi & ~other._hi); }
+    CardMask &operator|=(const CardMask &other) { _lo |= other._lo; _hi |= other._hi; return *this; }
+    CardMask &operator&=(const CardMask &other) { _lo &= other._lo; _hi &= other._hi; return *this; }
+    CardMask &operator-=(const CardMask &other) { _lo &= ~other._lo; _hi &= ~other._hi; return *this; }
+    bool operator==(const CardMask &other) const { return _lo == other._lo && _hi == other._hi; }
+    bool operator!=(const CardMask &other) const { return !(*this == other); }
+    quint64 hashKey() const { return (_lo ^ (_hi * Q_UINT64_C(0x9E3779B97F4A7C15))) * Q_UINT64_C(0xBF58476D1CE4E5B9); }
+
+    bool isGoodRankSet() const;
+    bool isGoodRunSet() const;
+    bool isGoodSetOfType(CardGroup::SetType setTypeWanted) const;
+    bool isGoodSet(CardGroup::SetType &setType) const;
+    bool isGoodSet() const;
+    int arrangedCardIds(int ids[MaxCards]) const;
+
+    class const_iterator
+    {
+        // iterates the card ids in the mask, in ascending order
+    public:
+        const_iterator(quint64 lo, quint64 hi) : _lo(lo), _hi(hi) {}
+        int operator*() const { return (_lo != 0) ? qCountTrailingZeroBits(_lo) : 64 + qCountTrailingZeroBits(_hi); }
+        const_iterator &operator++() { if (_lo != 0) _lo &= _lo - 1; else _hi &= _hi - 1; return *this; }
+        bool operator==(const const_iterator &other) const { return _lo == other._lo && _hi == other._hi; }
+        bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+    private:
+        quint64 _lo, _hi;
+    };
+    const_iterator begin() const { return const_iterator(_lo, _hi); }
+    const_iterator end() const { return const_iterator(0, 0); }
+};
+
+#endif // CARDMASK_H
@@ -0,0 +1,262 @@
+#include <atomic>
+
+#include "cardsetbatch.h"
+#include "cardsettables.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CARDSETBATCH_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(CARDSETBATCH_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CARDSETBATCH_AVX2
+#include <immintrin.h>
+#endif
+
+// each kernel checks every candidate in the batch the same way, without branching on the cards:
+// a rank set has every card of one rank, and no two cards of the same suit
+// a run set has every card of one suit, and ranks which make an unbroken run (allowing for the "wraparound" at an Ace)
+// for the run, the ranks are sorted and the gaps between them taken *round* the 13 ranks (the last gap being from the highest rank back to the lowest)
+// `n` different ranks make a run exactly when `n - 1` of those `n` gaps are 1
+// (the gaps add up to 13, so the `n`th gap is then more than 1, and no two cards can share a rank)
+
+namespace
+{
+    typedef quint8 Lanes[CardSetBatch::Capacity];
+    typedef void (*KernelFunction)(const Lanes ranks[], const Lanes suits[], int setCards, int count, quint64 &rankSets, quint64 &runSets);
+
+    void validateScalar(const Lanes ranks[], const Lanes suits[], int setCards, int count, quint64 &rankSets, quint64 &runSets)
+    {
+        rankSets = runSets = 0;
+        for (int lane = 0; lane < count; lane++)
+        {
+            bool sameRank = true, sameSuit = true, differentSuits = true;
+            int sorted[CardSetBatch::MaxSetCards] = {};
+            for (int c = 0; c < setCards; c++)
+            {
+                sameRank = sameRank && ranks[c][lane] == ranks[0][lane];
+                sameSuit = sameSuit && suits[c][lane] == suits[0][lane];
+                for (int d = 0; d < c; d++)
+                    differentSuits = differentSuits && suits[c][lane] != suits[d][lane];
+                int rank = ranks[c][lane], d = c;
+                for (; d > 0 && sorted[d - 1] > rank; d--)
+                    sorted[d] = sorted[d - 1];
+                sorted[d] = rank;
+            }
+            int gapsOf1 = (sorted[0] + CardSetTables::RankCount - sorted[setCards - 1] == 1) ? 1 : 0;
+            for (int c = 1; c < setCards; c++)
+                if (sorted[c] - sorted[c - 1] == 1)
+                    gapsOf1++;
+            if (sameRank && differentSuits)
+                rankSets |= Q_UINT64_C(1) << lane;
+            if (sameSuit && gapsOf1 == setCards - 1)
+                runSets |= Q_UINT64_C(1) << lane;
+        }
+    }
+
+#ifdef CARDSETBATCH_SSE2
+    inline void sortPair(__m128i &a, __m128i &b)
+    {
+        __m128i lo(_mm_min_epu8(a, b));
+        b = _mm_max_epu8(a, b);
+        a = lo;
+    }
+
+    void validateSse2(const Lanes ranks[], const Lanes suits[], int setCards, int count, quint64 &rankSets, quint64 &runSets)
+    {
+        rankSets = runSets = 0;
+        const __m128i one(_mm_set1_epi8(1)), rankCount(_mm_set1_epi8(CardSetTables::RankCount)), runGapsOf1(_mm_set1_epi8(char(setCards - 1)));
+        for (int lane = 0; lane < count; lane += 16)
+        {
+            __m128i rank[CardSetBatch::MaxSetCards] = {}, suit[CardSetBatch::MaxSetCards] = {};
+            for (int c = 0; c < setCards; c++)
+            {
+                rank[c] = _mm_load_si128(reinterpret_cast<const __m128i *>(ranks[c] + lane));
+                suit[c] = _mm_load_si128(reinterpret_cast<const __m128i *>(suits[c] + lane));
+            }
+            __m128i sameRank(_mm_set1_epi8(-1)), sameSuit(sameRank), anySuitsEqual(_mm_setzero_si128());
+            for (int c = 1; c < setCards; c++)
+            {
+                sameRank = _mm_and_si128(sameRank, _mm_cmpeq_epi8(rank[c], rank[0]));
+                sameSuit = _mm_and_si128(sameSuit, _mm_cmpeq_epi8(suit[c], suit[0]));
+                for (int d = 0; d < c; d++)
+                    anySuitsEqual = _mm_or_si128(anySuitsEqual, _mm_cmpeq_epi8(suit[c], suit[d]));
+            }
+            if (setCards == 3)
+            {
+                sortPair(rank[0], rank[1]); sortPair(rank[1], rank[2]); sortPair(rank[0], rank[1]);
+            }
+            else
+            {
+                sortPair(rank[0], rank[1]); sortPair(rank[2], rank[3]); sortPair(rank[0], rank[2]); sortPair(rank[1], rank[3]); sortPair(rank[1], rank[2]);
+            }
+            // (each gap of 1 counts as -1, the `cmpeq` result)
+            __m128i gapsOf1(_mm_cmpeq_epi8(_mm_sub_epi8(_mm_add_epi8(rank[0], rankCount), rank[setCards - 1]), one));
+            for (int c = 1; c < setCards; c++)
+                gapsOf1 = _mm_add_epi8(gapsOf1, _mm_cmpeq_epi8(_mm_sub_epi8(rank[c], rank[c - 1]), one));
+            __m128i run(_mm_and_si128(sameSuit, _mm_cmpeq_epi8(_mm_sub_epi8(_mm_setzero_si128(), gapsOf1), runGapsOf1)));
+            rankSets |= quint64(quint32(_mm_movemask_epi8(_mm_andnot_si128(anySuitsEqual, sameRank)))) << lane;
+            runSets |= quint64(quint32(_mm_movemask_epi8(run))) << lane;
+        }
+        if (count < CardSetBatch::Capacity)
+        {
+            rankSets &= (Q_UINT64_C(1) << count) - 1;
+            runSets &= (Q_UINT64_C(1) << count) - 1;
+        }
+    }
+#endif
+
+#ifdef CARDSETBATCH_AVX2
+    __attribute__((target("avx2")))
+    inline void sortPair(__m256i &a, __m256i &b)
+    {
+        __m256i lo(_mm256_min_epu8(a, b));
+        b = _mm256_max_epu8(a, b);
+        a = lo;
+    }
+
+    __attribute__((target("avx2")))
+    void validateAvx2(const Lanes ranks[], const Lanes suits[], int setCards, int count, quint64 &rankSets, quint64 &runSets)
+    {
+        rankSets = runSets = 0;
+        const __m256i one(_mm256_set1_epi8(1)), rankCount(_mm256_set1_epi8(CardSetTables::RankCount)), runGapsOf1(_mm256_set1_epi8(char(setCards - 1)));
+        for (int lane = 0; lane < count; lane += 32)
+        {
+            __m256i rank[CardSetBatch::MaxSetCards] = {}, suit[CardSetBatch::MaxSetCards] = {};
+            for (int c = 0; c < setCards; c++)
+            {
+                rank[c] = _mm256_load_si256(reinterpret_cast<const __m256i *>(ranks[c] + lane));
+                suit[c] = _mm256_load_si256(reinterpret_cast<const __m256i *>(suits[c] + lane));
+            }
+            __m256i sameRank(_mm256_set1_epi8(-1)), sameSuit(sameRank), anySuitsEqual(_mm256_setzero_si256());
+            for (int c = 1; c < setCards; c++)
+            {
+                sameRank = _mm256_and_si256(sameRank, _mm256_cmpeq_epi8(rank[c], rank[0]));
+                sameSuit = _mm256_and_si256(sameSuit, _mm256_cmpeq_epi8(suit[c], suit[0]));
+                for (int d = 0; d < c; d++)
+                    anySuitsEqual = _mm256_or_si256(anySuitsEqual, _mm256_cmpeq_epi8(suit[c], suit[d]));
+            }
+            if (setCards == 3)
+            {
+                sortPair(rank[0], rank[1]); sortPair(rank[1], rank[2]); sortPair(rank[0], rank[1]);
+            }
+            else
+            {
+                sortPair(rank[0], rank[1]); sortPair(rank[2], rank[3]); sortPair(rank[0], rank[2]); sortPair(rank[1], rank[3]); sortPair(rank[1], rank[2]);
+            }
+            __m256i gapsOf1(_mm256_cmpeq_epi8(_mm256_sub_epi8(_mm256_add_epi8(rank[0], rankCount), rank[setCards - 1]), one));
+            for (int c = 1; c < setCards; c++)
+                gapsOf1 = _mm256_add_epi8(gapsOf1, _mm256_cmpeq_epi8(_mm256_sub_epi8(rank[c], rank[c - 1]), one));
+            __m256i run(_mm256_and_si256(sameSuit, _mm256_cmpeq_epi8(_mm256_sub_epi8(_mm256_setzero_si256(), gapsOf1), runGapsOf1)));
+            rankSets |= quint64(quint32(_mm256_movemask_epi8(_mm256_andnot_si256(anySuitsEqual, sameRank)))) << lane;
+            runSets |= quint64(quint32(_mm256_movemask_epi8(run))) << lane;
+        }
+        if (count < CardSetBatch::Capacity)
+        {
+            rankSets &= (Q_UINT64_C(1) << count) - 1;
+            runSets &= (Q_UINT64_C(1) << count) - 1;
+        }
+    }
+#endif
+
+    CardSetBatch::Kernel bestKernel()
+    {
+        // chosen once, at run time, from what the CPU supports
+        if (CardSetBatch::isKernelSupported(CardSetBatch::Avx2Kernel))
+            return CardSetBatch::Avx2Kernel;
+        if (CardSetBatch::isKernelSupported(CardSetBatch::Sse2Kernel))
+            return CardSetBatch::Sse2Kernel;
+        return CardSetBatch::ScalarKernel;
+    }
+
+    std::atomic<int> s_kernel(bestKernel());
+
+    KernelFunction kernelFunction(CardSetBatch::Kernel kernel)
+    {
+        switch (kernel)
+        {
+#ifdef CARDSETBATCH_AVX2
+        case CardSetBatch::Avx2Kernel: return validateAvx2;
+#endif
+#ifdef CARDSETBATCH_SSE2
+        case CardSetBatch::Sse2Kernel: return validateSse2;
+#endif
+        default: return validateScalar;
+        }
+    }
+}
+
+CardSetBatch::CardSetBatch(int setCards /*= 3*/)
+    : _setCards(setCards), _count(0), _goodRankSets(0), _goodRunSets(0), _ranks{}, _suits{}, _ids{}
+{
+    Q_ASSERT(setCards >= 3 && setCards <= MaxSetCards);
+}
+
+int CardSetBatch::append(const int ids[])
+{
+    // append a candidate set of `setCards()` cards, and return its bit number in the results
+    Q_ASSERT(!isFull());
+    for (int c = 0; c < _setCards; c++)
+    {
+        int face = ids[c] % 52;
+        _ranks[c][_count] = quint8(face / 4);
+        _suits[c][_count] = quint8(face % 4);
+        _ids[c][_count] = quint8(ids[c]);
+    }
+    return _count++;
+}
+
+int CardSetBatch::append(int id0, int id1, int id2)
+{
+    Q_ASSERT(_setCards == 3);
+    const int ids[3] = { id0, id1, id2 };
+    return append(ids);
+}
+
+void CardSetBatch::validate()
+{
+    // the lanes past `count()` hold whatever was last there, and are masked out of the results
+    kernelFunction(kernel())(_ranks, _suits, _setCards, _count, _goodRankSets, _goodRunSets);
+}
+
+/*static*/ CardSetBatch::Kernel CardSetBatch::kernel()
+{
+    return Kernel(s_kernel.load(std::memory_order_relaxed));
+}
+
+/*static*/ bool CardSetBatch::setKernel(Kernel kernel)
+{
+    // for benchmarking & checking the kernels against each other; false if the CPU (or the build) does not support `kernel`
+    if (!isKernelSupported(kernel))
+        return false;
+    s_kernel.store(kernel, std::memory_order_relaxed);
+    return true;
+}
+
+/*static*/ bool CardSetBatch::isKernelSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case ScalarKernel: return true;
+#ifdef CARDSETBATCH_SSE2
+    case Sse2Kernel: return true;
+#endif
+#ifdef CARDSETBATCH_AVX2
+    case Avx2Kernel:
+        // (this can run before `main()`, when choosing the kernel, so the CPU's features must be looked up first)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default: return false;
+    }
+}
+
+/*static*/ const char *CardSetBatch::kernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case ScalarKernel: return "scalar";
+    case Sse2Kernel: return "sse2";
+    case Avx2Kernel: return "avx2";
+    }
+    return "";
+}
@@ -0,0 +1,49 @@
+#ifndef CARDSETBATCH_H
+#define CARDSETBATCH_H
+
+#include <QtGlobal>
+
+class CardSetBatch
+{
+    // a batch of candidate sets of 3 or 4 cards, checked all at once
+    // the cards' ranks & suits are held as byte arrays, one per position in the set ("structure of arrays"),
+    // so that a SIMD kernel can check 16 (SSE2) or 32 (AVX2) candidates per instruction
+    // `validate()` gives the results as bit masks, bit `n` for the `n`th candidate appended
+    // a good set is as `CardMask::isGoodRankSet()` or `CardMask::isGoodRunSet()` says for the same cards
+
+public:
+    static constexpr int Capacity = 64;
+    static constexpr int MaxSetCards = 4;
+
+    enum Kernel { ScalarKernel, Sse2Kernel, Avx2Kernel };
+
+    explicit CardSetBatch(int setCards = 3);
+
+    int setCards() const { return _setCards; }
+    int count() const { return _count; }
+    bool isEmpty() const { return _count == 0; }
+    bool isFull() const { return _count == Capacity; }
+    void clear() { _count = 0; _goodRankSets = _goodRunSets = 0; }
+    int append(const int ids[]);
+    int append(int id0, int id1, int id2);
+    int cardId(int candidate, int position) const { return _ids[position][candidate]; }
+
+    void validate();
+    quint64 goodRankSets() const { return _goodRankSets; }
+    quint64 goodRunSets() const { return _goodRunSets; }
+    quint64 goodSets() const { return _goodRankSets | _goodRunSets; }
+
+    static Kernel kernel();
+    static bool setKernel(Kernel kernel);
+    static bool isKernelSupported(Kernel kernel);
+    static const char *kernelName(Kernel kernel);
+
+private:
+    int _setCards, _count;
+    quint64 _goodRankSets, _goodRunSets;
+    alignas(32) quint8 _ranks[MaxSetCards][Capacity];
+    alignas(32) quint8 _suits[MaxSetCards][Capacity];
+    quint8 _ids[MaxSetCards][Capacity];
+};
+
+#endif // CARDSETBATCH_H
@@ -0,0 +1,60 @@
+#ifndef CARDSETTABLES_H
+#define CARDSETTABLES_H
+
+#include <array>
+
+#include <QtGlobal>
+
+namespace CardSetTables
+{
+    // lookup tables for checking sets, generated at compile time
+    // ranks go 0 (Two) .. 12 (Ace), and the Ace "wraps around" to be either high or low (like Q-K-A or A-2-3)
+
+    constexpr int RankCount = 13;
+    constexpr int SuitCount = 4;
+    constexpr quint32 AllRanks = (1 << RankCount) - 1;
+
+    constexpr std::array<std::array<qint8, RankCount>, RankCount> makeRankDifferences()
+    {
+        // the difference in rank *from* rank1 *to* rank0, taking whichever way round the wraparound is shorter
+        std::array<std::array<qint8, RankCount>, RankCount> differences{};
+        for (int rank0 = 0; rank0 < RankCount; rank0++)
+            for (int rank1 = 0; rank1 < RankCount; rank1++)
+            {
+                int diff0(rank0 - rank1);
+                int diff1((diff0 > 0) ? diff0 - RankCount : diff0 + RankCount);
+                differences[rank0][rank1] = qint8(((diff0 < 0 ? -diff0 : diff0) < (diff1 < 0 ? -diff1 : diff1)) ? diff0 : diff1);
+            }
+        return differences;
+    }
+
+    constexpr std::array<qint8, 1 << RankCount> makeRunTopRanks()
+    {
+        // for each 13-bit mask of ranks, the top rank if they make one unbroken run (allowing for the wraparound), else -1
+        // all 13 ranks run from the Ace down
+        std::array<qint8, 1 << RankCount> topRanks{};
+        for (quint32 ranks = 0; ranks <= AllRanks; ranks++)
+            topRanks[ranks] = -1;
+        topRanks[AllRanks] = RankCount - 1;
+        for (int bottom = 0; bottom < RankCount; bottom++)
+        {
+            quint32 ranks = 0;
+            for (int length = 1; length < RankCount; length++)
+            {
+                int top = (bottom + length - 1) % RankCount;
+                ranks |= 1u << top;
+                topRanks[ranks] = qint8(top);
+            }
+        }
+        return topRanks;
+    }
+
+    inline constexpr std::array<std::array<qint8, RankCount>, RankCount> RankDifferences = makeRankDifferences();
+    inline constexpr std::array<qint8, 1 << RankCount> RunTopRanks = makeRunTopRanks();
+
+    inline int rankDifference(int rank0, int rank1) { return RankDifferences[rank0][rank1]; }
+    inline bool isRunOfRanks(quint32 ranks) { return RunTopRanks[ranks] >= 0; }
+    inline int runTopRank(quint32 ranks) { return RunTopRanks[ranks]; }
+}
+
+#endif // CARDSETTABLES_H
@@ -0,0 +1,28 @@
+# the game engine (cards, sets, the logical model & the AI), which needs only QtCore
+# included by the game's project and by each command-line tool's
+CONFIG += c++17 warn_on
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/aimodel.cpp \
+    $$PWD/card.cpp \
+    $$PWD/carddeck.cpp \
+    $$PWD/cardgroup.cpp \
+    $$PWD/cardhand.cpp \
+    $$PWD/cardmask.cpp \
+    $$PWD/cardsetbatch.cpp \
+    $$PWD/logicalmodel.cpp \
+    $$PWD/utils.cpp
+
+HEADERS += \
+    $$PWD/aimodel.h \
+    $$PWD/card.h \
+    $$PWD/carddeck.h \
+    $$PWD/cardgroup.h \
+    $$PWD/cardhand.h \
+    $$PWD/cardmask.h \
+    $$PWD/cardsetbatch.h \
+    $$PWD/cardsettables.h \
+    $$PWD/logicalmodel.h \
+    $$PWD/utils.h
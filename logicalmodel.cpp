@@ -1,3 +1,5 @@
+#include <QJsonArray>
+
 #include "logicalmodel.h"
 
 LogicalModel::LogicalModel()
@@ -110,6 +112,90 @@ const Card *LogicalModel::extractCardFromDrawPile(int index)
     return card;
 }
 
+void LogicalModel::makePlays(const CardGroups &cardGroupsChanged)
+{
+    // make the active player's plays, given as the groups they change (as an `AiModelState` holds them)
+    // a changed group is matched to the model's by its unique id: a new id adds a group, an empty group deletes one, otherwise it is modified
+    // (`MainWindow::aiModelMakePlays()` moves the cards on the baize, then calls this)
+    CardHand &hand(hands[activePlayer]);
+    for (int pass = 0; pass < 2; pass++)
+        for (const CardGroup &changedCardGroup : cardGroupsChanged)
+        {
+            enum ChangeType { Add, Delete, Modify } changeType;
+            int oldCardGroupIndex = cardGroups.findCardGroupByUniqueId(changedCardGroup.uniqueId());
+            if (oldCardGroupIndex < 0)
+                changeType = Add;
+            else if (changedCardGroup.isEmpty())
+                changeType = Delete;
+            else
+                changeType = Modify;
+
+            if (pass == 0 && changeType == Delete)
+                continue;
+            else if (pass == 1 && changeType != Delete)
+                continue;
+
+            if (changeType == Add && changedCardGroup.isEmpty())
+                continue;
+            else if (changeType == Delete && oldCardGroupIndex < 0)
+                continue;
+            else if (changeType == Modify && cardGroups.at(oldCardGroupIndex) == changedCardGroup)
+                continue;
+
+            if (changeType == Delete)
+            {
+                Q_ASSERT(cardGroups.at(oldCardGroupIndex).isEmpty());
+                continue;
+            }
+
+            Q_ASSERT(changedCardGroup.count() >= 3);
+            Q_ASSERT(changedCardGroup.isGoodSet());
+            for (const Card *card : changedCardGroup)
+                Q_ASSERT(hand.contains(card) || cardGroups.findCardInGroups(card) >= 0);
+
+            if (changeType == Add)
+            {
+                for (const Card *card : changedCardGroup)
+                {
+                    if (hand.contains(card))
+                        hand.removeOne(card);
+                    else
+                    {
+                        int wasInGroup = cardGroups.removeCardFromGroups(card);
+                        Q_ASSERT(wasInGroup >= 0);
+                    }
+                }
+                cardGroups.append(changedCardGroup);
+            }
+            else if (changeType == Modify)
+            {
+                CardGroup &existingCardGroup(cardGroups[oldCardGroupIndex]);
+                for (const Card *card : changedCardGroup)
+                {
+                    if (hand.contains(card))
+                        hand.removeOne(card);
+                    else
+                    {
+                        if (existingCardGroup.contains(card))
+                            continue;
+                        int wasInGroup = cardGroups.removeCardFromGroups(card);
+                        Q_ASSERT(wasInGroup >= 0);
+                    }
+                    existingCardGroup.append(card);
+                }
+            }
+        }
+
+    // tidy up, as `MainWindow::tidyGroups()` (which the GUI calls after this, to lay the groups out)
+    updateInitialFreeCards();
+    cardGroups.removeEmptyGroups();
+    for (CardGroup &group : cardGroups)
+    {
+        group.rearrangeForSets();
+        Q_ASSERT(group.isGoodSet() || isInitialCardGroup(group));
+    }
+}
+
 void LogicalModel::startOfTurn()
 {
     updateInitialFreeCards();
@@ -124,3 +210,61 @@ void LogicalModel::endOfTurn()
     if (++activePlayer >= hands.totalHands)
         activePlayer = 0;
 }
+
+
+
+LogicalModelSnapshot::LogicalModelSnapshot()
+{
+    this->_activePlayer = -1;
+    this->_nextCardToBeDealt = 0;
+}
+
+LogicalModelSnapshot::LogicalModelSnapshot(const LogicalModel &logicalModel)
+    : _cards(logicalModel.cardDeck), _initialFreeCards(logicalModel.cardDeck.initialFreeCards()), _hands(logicalModel.hands)
+{
+    this->_activePlayer = logicalModel.activePlayer;
+    this->_nextCardToBeDealt = logicalModel.cardDeck.nextCardToBeDealt;
+    // each group is copied, rather than sharing the model's, as a group keeps its own classification as a set,
+    // a cache which is not thread-safe, so the AI's thread must never classify a group the UI's thread can also classify
+    for (const CardGroup &group : logicalModel.cardGroups)
+        _cardGroups.append(group);
+}
+
+QJsonDocument LogicalModelSnapshot::serializeToJson() const
+{
+    // as `MainWindow::serializeToJson()` (with the deck as `CardDeck::serializeToJson()`), so it can be loaded as a `.sav` file
+    // there is no scene to copy, so the scene has the baize's groups set out on a grid, for loading into the game
+    QJsonObject objCardDeck;
+    objCardDeck["nextCardToBeDealt"] = _nextCardToBeDealt;
+    QJsonArray arrCards;
+    for (const Card *card : _cards)
+        arrCards.append(card->id);
+    objCardDeck["cards"] = arrCards;
+    QJsonArray arrFreeCards;
+    for (const Card *card : _initialFreeCards)
+        arrFreeCards.append(card->id);
+    objCardDeck["initialFreeCards"] = arrFreeCards;
+
+    QJsonObject obj;
+    obj["activePlayer"] = _activePlayer;
+    obj["cardDeck"] = objCardDeck;
+    obj["hands"] = _hands.serializeToJson();
+    obj["cardGroups"] = _cardGroups.serializeToJson();
+    QJsonArray arrItems;
+    for (int i = 0; i < _cardGroups.count(); i++)
+        for (const Card *card : _cardGroups.at(i))
+        {
+            QJsonObject objItem;
+            objItem["x"] = -600 + (i % 4) * 400;
+            objItem["y"] = -300 + (i / 4) * 150;
+            objItem["card"] = card->id;
+            arrItems.append(objItem);
+        }
+    QJsonObject objScene;
+    objScene["items"] = arrItems;
+    obj["scene"] = objScene;
+
+    QJsonDocument doc;
+    doc.setObject(obj);
+    return doc;
+}
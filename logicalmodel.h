@@ -1,6 +1,9 @@
 #ifndef LOGICALMODEL_H
 #define LOGICALMODEL_H
 
+#include <QJsonDocument>
+#include <QMetaType>
+
 #include "carddeck.h"
 #include "cardhand.h"
 #include "cardgroup.h"
@@ -27,6 +30,7 @@ public:
     CardGroups badSetGroups() const;
     const Card *drawCardFromDrawPile();
     const Card *extractCardFromDrawPile(int index);
+    void makePlays(const CardGroups &cardGroupsChanged);
     void startOfTurn();
     void endOfTurn();
 
@@ -34,4 +38,34 @@ private:
     CardHand _startOfTurnHand;
 };
 
+
+
+class LogicalModelSnapshot
+{
+    // an unchanging copy of the state of a `LogicalModel` at one moment,
+    // which can be read on another thread (the AI's) while the model itself goes on changing
+    // the `Card`s themselves are shared, not copied: they belong to the model's deck, and never change
+public:
+    LogicalModelSnapshot();
+    explicit LogicalModelSnapshot(const LogicalModel &logicalModel);
+
+    int activePlayer() const { return _activePlayer; }
+    const QList<const Card *> &cards() const { return _cards; }
+    const QList<const Card *> &initialFreeCards() const { return _initialFreeCards; }
+    const CardHands &hands() const { return _hands; }
+    const CardGroups &cardGroups() const { return _cardGroups; }
+    QJsonDocument serializeToJson() const;
+
+private:
+    int _activePlayer;
+    int _nextCardToBeDealt;
+    QList<const Card *> _cards;
+    QList<const Card *> _initialFreeCards;
+    CardHands _hands;
+    CardGroups _cardGroups;
+};
+
+// (passed to the AI's thread by a queued connection)
+Q_DECLARE_METATYPE(LogicalModelSnapshot)
+
 #endif // LOGICALMODEL_H
@@ -12,6 +12,7 @@
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QSaveFile>
+#include <QStatusBar>
 
 #include "baizescene.h"
 #include "baizeview.h"
@@ -47,8 +48,18 @@ MainWindow::MainWindow(QWidget *parent)
     connect(baizeScene, &BaizeScene::multipleCardsMoved, this, &MainWindow::baizeSceneMultipleCardsMoved);
     connect(baizeScene, &BaizeScene::drawPileDoubleClicked, this, &MainWindow::drawCardFromDrawPile);
 
-    connect(this, &MainWindow::aiModelMakeTurn, &aiModel, &AiModel::makeTurn);
-    connect(&aiModel, &AiModel::makeTurnPlay, this, &MainWindow::aiModelMakeTurnPlay);
+    // the AI makes its turns on its own thread, from a snapshot of the model, so that the UI carries on while it searches
+    this->aiModel = new AiModel;
+    this->aiTurnNumber = 0;
+    this->aiMakingTurn = false;
+    // (Qt 5 can only queue arguments of types registered at run time)
+    qRegisterMetaType<LogicalModelSnapshot>();
+    qRegisterMetaType<AiModelState>();
+    aiModel->moveToThread(&aiThread);
+    connect(&aiThread, &QThread::finished, aiModel, &QObject::deleteLater);
+    connect(this, &MainWindow::aiModelMakeTurn, aiModel, &AiModel::makeTurn, Qt::QueuedConnection);
+    connect(aiModel, &AiModel::makeTurnProgress, this, &MainWindow::aiModelMakeTurnProgress, Qt::QueuedConnection);
+    connect(aiModel, &AiModel::makeTurnPlay, this, &MainWindow::aiModelMakeTurnPlay, Qt::QueuedConnection);
 
     cardDeck.createCards();
 
@@ -58,8 +69,17 @@ MainWindow::MainWindow(QWidget *parent)
     hands.aiPlayers = { true };
     hands.initialHandCardCount = 13;
 
-    this->aiModel.setDebugLevel(0);
-    this->aiModel.logicalModel = &this->logicalModel;
+    this->aiModel->setDebugLevel(0);
+    AiModel::SearchSettings aiSearchSettings(this->aiModel->searchSettings());
+    aiSearchSettings.deterministic = false;
+    aiSearchSettings.maxRearrangeDepth = AiModel::MaxRearrangeDepth;
+    aiSearchSettings.timeLimitMs = 2000;
+    aiSearchSettings.planTurn = true;
+    // to keep the positions of turns which come near the time limit, for benchmarking (off for play, `selfplay --slow-positions` is the tool for this)
+    // aiSearchSettings.slowTurnMs = 1000;
+    // aiSearchSettings.slowPositionsPath = appSavesPath() + "/slow";
+    this->aiModel->setSearchSettings(aiSearchSettings);
+    aiThread.start();
 
     actionDeal();
     Q_ASSERT(!logicalModel.isDealOver(true));
@@ -68,6 +88,9 @@ MainWindow::MainWindow(QWidget *parent)
 MainWindow::~MainWindow()
 {
     disconnect(baizeView, &BaizeView::viewCoordinatesChanged, this, &MainWindow::baizeViewCoordinatesChanged);
+    cancelAiTurn();
+    aiThread.quit();
+    aiThread.wait();
 }
 
 /*virtual*/ void MainWindow::closeEvent(QCloseEvent *event) /*override*/
@@ -361,10 +384,27 @@ void MainWindow::startTurn(bool restart /*= false*/)
         logicalModel.startOfTurn();
         autosave();
     }
+    // while the AI searches (from a snapshot of the model) the human must not change the model
+    aiMakingTurn = hands.isAiPlayer(activePlayer);
     updateDrawCardEndTurnAction();
 
-    if (hands.isAiPlayer(activePlayer))
-        QTimer::singleShot(aiContinuousPlayFast() ? 0 : restart ? 2000 : 100, this, [this]() { emit aiModelMakeTurn(); });
+    if (aiMakingTurn)
+    {
+        int turnNumber = ++aiTurnNumber;
+        QTimer::singleShot(aiContinuousPlayFast() ? 0 : restart ? 2000 : 100, this, [this, turnNumber]() {
+            // unless the turn has been cancelled in the meantime
+            if (turnNumber == aiTurnNumber)
+                emit aiModelMakeTurn(LogicalModelSnapshot(logicalModel), turnNumber);
+        });
+    }
+}
+
+void MainWindow::cancelAiTurn()
+{
+    // cancel the turn the AI is making (or is about to make), and ignore its play if that is already on its way back
+    aiModel->cancelTurn(aiTurnNumber);
+    aiTurnNumber++;
+    aiMakingTurn = false;
 }
 
 void MainWindow::autosave()
@@ -415,105 +455,61 @@ void MainWindow::reportDealIsOver(int winner)
 void MainWindow::aiModelMakePlays(const AiModelState &turnPlay)
 {
     Q_ASSERT(hands.isAiPlayer(activePlayer));
-    CardHand &aiHand(hands[activePlayer]);
     const CardGroups &cardGroupsChanged(turnPlay.cardGroups);
     Q_ASSERT(!cardGroupsChanged.isEmpty());
-    const AiModelState originalState(aiHand, cardGroups);
 
-    for (int pass = 0; pass < 2; pass++)
-        for (const CardGroup &changedCardGroup : cardGroupsChanged)
+    // move the cards on the baize to where their groups will be, before the model is changed
+    // (the groups are laid out properly by `tidyGroups()` afterwards)
+    for (const CardGroup &changedCardGroup : cardGroupsChanged)
+    {
+        int oldCardGroupIndex = cardGroups.findCardGroupByUniqueId(changedCardGroup.uniqueId());
+        if (changedCardGroup.isEmpty())
         {
-            enum ChangeType { Add, Delete, Modify } changeType;
-            int oldCardGroupIndex = cardGroups.findCardGroupByUniqueId(changedCardGroup.uniqueId());
-            if (oldCardGroupIndex < 0)
-                changeType = Add;
-            else if (changedCardGroup.isEmpty())
-                changeType = Delete;
-            else
-                changeType = Modify;
-
-            if (pass == 0 && changeType == Delete)
-                continue;
-            else if (pass == 1 && changeType != Delete)
-                continue;
-
-            if (changeType == Add && changedCardGroup.isEmpty())
-                continue;
-            else if (changeType == Delete && oldCardGroupIndex < 0)
-                continue;
-            else if (changeType == Modify && cardGroups.at(oldCardGroupIndex) == changedCardGroup)
-                continue;
+            if (oldCardGroupIndex >= 0 && aiModel->debugLevel() >= 1)
+                qDebug() << "    " << __FUNCTION__ << "Deleted Group" << changedCardGroup.uniqueId() << cardGroups.at(oldCardGroupIndex).toString();
+            continue;
+        }
 
-            if (changeType == Delete)
-            {
-                Q_ASSERT(cardGroups.at(oldCardGroupIndex).isEmpty());
-                if (aiModel.debugLevel() >= 1)
-                    qDebug() << "    " << __FUNCTION__ << "Deleted Group" << changedCardGroup.uniqueId() << originalState.cardGroups.at(oldCardGroupIndex).toString();
+        if (oldCardGroupIndex < 0)
+        {
+            if (aiModel->debugLevel() >= 1)
+                qDebug() << "    " << __FUNCTION__ << "Added Group" << changedCardGroup.uniqueId() << changedCardGroup.toString();
+            if (aiContinuousPlayFast())
                 continue;
-            }
-
-            Q_ASSERT(changedCardGroup.count() >= 3);
-            Q_ASSERT(changedCardGroup.isGoodSet());
+            // (try to) find free area for new card group
+            QPointF newGroupPoint = findFreeAreaForCardGroup(changedCardGroup);
             for (const Card *card : changedCardGroup)
-                Q_ASSERT(aiHand.contains(card) || cardGroups.findCardInGroups(card) >= 0);
-
-            if (changeType == Add)
             {
-                if (aiModel.debugLevel() >= 1)
-                    qDebug() << "    " << __FUNCTION__ << "Added Group" << changedCardGroup.uniqueId() << changedCardGroup.toString();
-                // (try to) find free area for new card group
-                QPointF newGroupPoint = findFreeAreaForCardGroup(changedCardGroup);
-
-                for (const Card *card : changedCardGroup)
-                {
-                    if (aiHand.contains(card))
-                        aiHand.removeOne(card);
-                    else
-                    {
-                        int wasInGroup = cardGroups.removeCardFromGroups(card);
-                        Q_ASSERT(wasInGroup >= 0);
-                    }
-                    if (!aiContinuousPlayFast())
-                    {
-                        CardPixmapItem *item = baizeScene->findItemForCard(card);
-                        Q_ASSERT(item);
-                        item->setPos(newGroupPoint);
-                    }
-                }
-                cardGroups.append(changedCardGroup);
+                CardPixmapItem *item = baizeScene->findItemForCard(card);
+                Q_ASSERT(item);
+                item->setPos(newGroupPoint);
             }
-            else if (changeType == Modify)
+        }
+        else
+        {
+            const CardGroup &existingCardGroup(cardGroups.at(oldCardGroupIndex));
+            if (existingCardGroup == changedCardGroup)
+                continue;
+            if (aiModel->debugLevel() >= 1)
+                qDebug() << "    " << __FUNCTION__ << "Modified Group" << changedCardGroup.uniqueId() << existingCardGroup.toString() << "-->" << changedCardGroup.toString();
+            if (aiContinuousPlayFast())
+                continue;
+            const CardPixmapItem *existingGroupItem = baizeScene->findItemForCard(existingCardGroup.first());
+            Q_ASSERT(existingGroupItem);
+            for (const Card *card : changedCardGroup)
             {
-                if (aiModel.debugLevel() >= 1)
-                    qDebug() << "    " << __FUNCTION__ << "Modified Group" << changedCardGroup.uniqueId() << originalState.cardGroups.at(oldCardGroupIndex).toString() << "-->" << changedCardGroup.toString();
-                CardGroup &existingCardGroup(cardGroups[oldCardGroupIndex]);
-                const Card *existingGroupCard = existingCardGroup.first();
-                for (const Card *card : changedCardGroup)
-                {
-                    if (aiHand.contains(card))
-                        aiHand.removeOne(card);
-                    else
-                    {
-                        if (existingCardGroup.contains(card))
-                            continue;
-                        int wasInGroup = cardGroups.removeCardFromGroups(card);
-                        Q_ASSERT(wasInGroup >= 0);
-                    }
-                    existingCardGroup.append(card);
-                    if (!aiContinuousPlayFast())
-                    {
-                        CardPixmapItem *item = baizeScene->findItemForCard(card);
-                        Q_ASSERT(item);
-                        const CardPixmapItem *existingGroupItem = baizeScene->findItemForCard(existingGroupCard);
-                        Q_ASSERT(existingGroupItem);
-                        item->setPos(existingGroupItem->pos());
-                    }
-                }
+                if (existingCardGroup.contains(card))
+                    continue;
+                CardPixmapItem *item = baizeScene->findItemForCard(card);
+                Q_ASSERT(item);
+                item->setPos(existingGroupItem->pos());
             }
         }
+    }
+
+    logicalModel.makePlays(cardGroupsChanged);
 
     // tidy up
-    logicalModel.updateInitialFreeCards();
     tidyGroups(true);
     showHand(activePlayer);
     updateDrawCardEndTurnAction();
@@ -561,6 +557,13 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
         return;
     Q_ASSERT(item);
     Q_ASSERT(item->card);
+    if (aiMakingTurn)
+    {
+        // a card dragged while the AI is searching is put back where it was
+        showHand(activePlayer, true);
+        tidyGroups();
+        return;
+    }
 
     int wasInHand = hands.findCardInHands(item->card);
     int wasInGroup = cardGroups.findCardInGroups(item->card);
@@ -659,6 +662,8 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
 
 /*slot*/ void MainWindow::drawCardFromDrawPile()
 {
+    if (aiMakingTurn)
+        return;
     if (havePlayedCard() || haveDrawnCard)
         return;
 
@@ -680,6 +685,8 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
 
 /*slot*/ void MainWindow::extractCardFromDrawPile(int id)
 {
+    if (aiMakingTurn)
+        return;
     const Card *card = logicalModel.extractCardFromDrawPile(id);
     if (card == nullptr)
         return;
@@ -690,17 +697,31 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
     }
 }
 
-/*slot*/ void MainWindow::aiModelMakeTurnPlay(AiModelState turnPlay)
+/*slot*/ void MainWindow::aiModelMakeTurnProgress(int turnNumber, int searchDepth, int searchNodes)
+{
+    if (turnNumber != aiTurnNumber)
+        return;
+    if (aiContinuousPlayFast())
+        return;
+    statusBar()->showMessage(QString("AI searching %1 rearrangement(s) deep, %2 positions searched so far").arg(searchDepth).arg(searchNodes));
+}
+
+/*slot*/ void MainWindow::aiModelMakeTurnPlay(int turnNumber, AiModelState turnPlay)
 {
+    // a play for a turn since cancelled is ignored
+    if (turnNumber != aiTurnNumber)
+        return;
+    aiMakingTurn = false;
+    statusBar()->clearMessage();
     if (turnPlay.isNull())
     {
-        if (aiModel.debugLevel() >= 1)
+        if (aiModel->debugLevel() >= 1)
             qDebug() << __FUNCTION__ << "AI draws card";
         drawCardFromDrawPile();
     }
     else
     {
-        if (aiModel.debugLevel() >= 1)
+        if (aiModel->debugLevel() >= 1)
             qDebug() << __FUNCTION__ << "AI makes play(s)";
         aiModelMakePlays(turnPlay);
     }
@@ -732,6 +753,7 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
     }
     else
     {
+        cancelAiTurn();
         logicalModel.updateInitialFreeCards();
         baizeScene->reset();
         showInitialFreeCards();
@@ -748,6 +770,10 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
         tidyGroups(true);
         serializationDoc = serializeToJson();
         showHands();
+        // the turn was cancelled (no AI turn is made while the scene is being remade), so restart it as `actionRestartTurn()` does,
+        // unless the deal is over, when the next deal is already on its way
+        if (!logicalModel.isDealOver(true))
+            startTurn(true);
     }
 }
 
@@ -793,6 +819,7 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
 
 /*slot*/ void MainWindow::actionDeal()
 {
+    cancelAiTurn();
     shuffleAndDeal();
     showInitialFreeCards();
     this->activePlayer = 0;
@@ -803,6 +830,7 @@ void MainWindow::deserializeFromJson(const QJsonDocument &doc)
 
 /*slot*/ void MainWindow::actionRestartTurn()
 {
+    cancelAiTurn();
     deserializeFromJson(serializationDoc);
     logicalModel.updateInitialFreeCards();
     tidyGroups(true);
@@ -815,14 +843,16 @@ void MainWindow::updateDrawCardEndTurnAction()
     if (aiContinuousPlayFast())
         return;
     menuActionDrawCardEndTurn->setText((havePlayedCard() || haveDrawnCard) ? "End Turn" : "Draw Card");
-    baizeScene->setPreventMovingCards(haveDrawnCard);
+    baizeScene->setPreventMovingCards(haveDrawnCard || aiMakingTurn);
     menuActionDrawCardEndTurn->setEnabled(logicalModel.badSetGroups().isEmpty());
-    if (logicalModel.isDealOver(true))
+    if (aiMakingTurn || logicalModel.isDealOver(true))
         menuActionDrawCardEndTurn->setEnabled(false);
 }
 
 /*slot*/ void MainWindow::actionDrawCardEndTurn()
 {
+    if (aiMakingTurn)
+        return;
     if (aiContinuousPlayFast())
         baizeScene->blinkingCard()->stop();
 
@@ -4,6 +4,7 @@
 #include <QJsonDocument>
 #include <QMainWindow>
 #include <QPlainTextEdit>
+#include <QThread>
 
 #include "logicalmodel.h"
 #include "aimodel.h"
@@ -35,7 +36,10 @@ private:
     CardDeck &cardDeck = logicalModel.cardDeck;
     CardHands &hands = logicalModel.hands;
     CardGroups &cardGroups = logicalModel.cardGroups;
-    AiModel aiModel;
+    QThread aiThread;
+    AiModel *aiModel;
+    int aiTurnNumber;
+    bool aiMakingTurn;
 
     enum HandLayout { HandLayoutHorizontal, HandLayoutHorizontalGapBetweenSuits, HandLayoutFan };
     HandLayout handLayout;
@@ -73,6 +77,7 @@ private:
     void tidyGroups(bool verifyNoBadBads = false);
     bool havePlayedCard() const;
     void startTurn(bool restart = false);
+    void cancelAiTurn();
     void autosave();
     QPointF findFreeAreaForCardGroup(const CardGroup &cardGroup) const;
     void reportDealIsOver(int winner);
@@ -86,7 +91,8 @@ private slots:
     void baizeSceneMultipleCardsMoved(QList<CardPixmapItem *> items);
     void drawCardFromDrawPile();
     void extractCardFromDrawPile(int id);
-    void aiModelMakeTurnPlay(AiModelState turnPlay);
+    void aiModelMakeTurnProgress(int turnNumber, int searchDepth, int searchNodes);
+    void aiModelMakeTurnPlay(int turnNumber, AiModelState turnPlay);
     void actionAiContinuousPlay(bool checked);
     void actionHandLayout(HandLayout handLayout);
     void actionLoadFile();
@@ -97,7 +103,7 @@ private slots:
     void actionDrawCardEndTurn();
 
 signals:
-    void aiModelMakeTurn();
+    void aiModelMakeTurn(const LogicalModelSnapshot &snapshot, int turnNumber);
 };
 
 #endif
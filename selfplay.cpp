@@ -0,0 +1,239 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include "aimodel.h"
+#include "logicalmodel.h"
+#include "utils.h"
+
+// self-play simulator: AI-only deals played without a GUI, as "AI Continuous Play (fast)" plays them, spread across the cores
+// each deal is played on its own thread, with its own model & AI, from its own random number seed (`--seed` plus the deal number),
+// so a deal plays the same however many threads are used, and any one deal can be played again
+// given a directory for slow positions, each turn taking at least `--slow-ms` or creating at least `--slow-states` search states has its position written there
+// `--measure-no-play-filter` makes the searches the "no play possible" filter skips anyway, to compare what skipping them saves with what the filter costs
+// usage: selfplay [--deals N] [--players N] [--threads N] [--depth N] [--seed N] [--results file.jsonl] [--slow-ms N] [--slow-states N] [--slow-positions directory] [--measure-no-play-filter]
+
+namespace
+{
+    const char *Usage = "usage: selfplay [--deals N] [--players N] [--threads N] [--depth N] [--seed N] [--results file.jsonl] [--slow-ms N] [--slow-states N] [--slow-positions directory] [--measure-no-play-filter]";
+
+    // 13 cards to each hand, and the 4 initial free cards, from the 104 cards
+    constexpr int MaxPlayers = (104 - 4) / 13;
+
+    struct DealResult
+    {
+        int deal = 0;
+        quint32 seed = 0;
+        int winner = -1;
+        int turns = 0;
+        QList<int> cardsLeft;
+        QList<qint64> aiTurnNs;
+        qint64 elapsedNs = 0;
+        // the "no play possible" filter's checks, the turns it skipped the search for, its time, and the skipped searches' time & states
+        long noPlayFilterChecks = 0;
+        long noPlayFilterHits = 0;
+        qint64 noPlayFilterNs = 0;
+        qint64 noPlayFilterSavedNs = 0;
+        long noPlayFilterSavedNodes = 0;
+    };
+
+    DealResult playDeal(int deal, quint32 seed, int players, const AiModel::SearchSettings &settings)
+    {
+        RandomNumber::random_generator().seed(seed);
+        LogicalModel logicalModel;
+        logicalModel.cardDeck.createCards();
+        logicalModel.hands.totalHands = players;
+        logicalModel.hands.aiPlayers.fill(true, players);
+        AiModel aiModel;
+        aiModel.setDebugLevel(0);
+        aiModel.setSearchSettings(settings);
+        AiModelState turnPlay;
+        QObject::connect(&aiModel, &AiModel::makeTurnPlay, [&turnPlay](int, AiModelState play) { turnPlay = play; });
+
+        DealResult result;
+        result.deal = deal;
+        result.seed = seed;
+        QElapsedTimer dealTimer;
+        dealTimer.start();
+        // as `MainWindow::actionDeal()`, then a turn at a time as `MainWindow::aiModelMakeTurnPlay()` & `MainWindow::actionDrawCardEndTurn()`
+        logicalModel.shuffleAndDeal();
+        logicalModel.activePlayer = 0;
+        logicalModel.hands.sortHands();
+        while (true)
+        {
+            logicalModel.startOfTurn();
+            turnPlay = AiModelState();
+            QElapsedTimer turnTimer;
+            turnTimer.start();
+            aiModel.makeTurn(LogicalModelSnapshot(logicalModel), ++result.turns);
+            result.aiTurnNs.append(turnTimer.nsecsElapsed());
+            // (the deal's AI searches on this thread, so its statistics are this thread's)
+            result.noPlayFilterChecks += AiModel::statistics.noPlayFilterChecks;
+            result.noPlayFilterHits += AiModel::statistics.noPlayFilterHits;
+            result.noPlayFilterNs += AiModel::statistics.noPlayFilterNs;
+            result.noPlayFilterSavedNs += AiModel::statistics.noPlayFilterSavedNs;
+            result.noPlayFilterSavedNodes += AiModel::statistics.noPlayFilterSavedNodes;
+            if (turnPlay.isNull())
+                logicalModel.drawCardFromDrawPile();
+            else
+                logicalModel.makePlays(turnPlay.cardGroups);
+            // (the deal is over when a hand is empty, or when the draw pile is, whether or not the player drew a card)
+            if (logicalModel.isDealOver(true, result.winner))
+                break;
+            logicalModel.endOfTurn();
+        }
+        result.elapsedNs = dealTimer.nsecsElapsed();
+        for (const CardHand &hand : logicalModel.hands)
+            result.cardsLeft.append(hand.count());
+        return result;
+    }
+
+    QJsonObject resultToJson(const DealResult &result)
+    {
+        QJsonArray cardsLeft, aiTurnUs;
+        for (int count : result.cardsLeft)
+            cardsLeft.append(count);
+        for (qint64 ns : result.aiTurnNs)
+            aiTurnUs.append(ns / 1000);
+        QJsonObject obj;
+        obj["deal"] = result.deal;
+        obj["seed"] = qint64(result.seed);
+        obj["winner"] = result.winner;
+        obj["turns"] = result.turns;
+        obj["cardsLeft"] = cardsLeft;
+        obj["aiTurnUs"] = aiTurnUs;
+        obj["elapsedUs"] = result.elapsedNs / 1000;
+        return obj;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    int deals = 100, players = 1, threads = QThread::idealThreadCount(), depth = 1;
+    quint32 seed = 1;
+    QString resultsPath;
+    AiModel::SearchSettings settings(AiModel().searchSettings());
+    const QStringList args(QCoreApplication::arguments().mid(1));
+    for (int i = 0; i < args.count(); i++)
+    {
+        if (args.at(i) == "--measure-no-play-filter")
+        {
+            settings.measureNoPlayFilter = true;
+            continue;
+        }
+        if (i + 1 >= args.count())
+        {
+            out << Usage << Qt::endl;
+            return 1;
+        }
+        if (args.at(i) == "--deals")
+            deals = qMax(1, args.at(++i).toInt());
+        else if (args.at(i) == "--players")
+            players = qBound(1, args.at(++i).toInt(), MaxPlayers);
+        else if (args.at(i) == "--threads")
+            threads = qMax(1, args.at(++i).toInt());
+        else if (args.at(i) == "--depth")
+            depth = qBound(0, args.at(++i).toInt(), AiModel::MaxRearrangeDepth);
+        else if (args.at(i) == "--seed")
+            seed = args.at(++i).toUInt();
+        else if (args.at(i) == "--results")
+            resultsPath = args.at(++i);
+        else if (args.at(i) == "--slow-ms")
+            settings.slowTurnMs = qMax(0, args.at(++i).toInt());
+        else if (args.at(i) == "--slow-states")
+            settings.slowTurnStates = qMax(0L, args.at(++i).toLong());
+        else if (args.at(i) == "--slow-positions")
+            settings.slowPositionsPath = args.at(++i);
+        else
+        {
+            out << Usage << Qt::endl;
+            return 1;
+        }
+    }
+
+    QFile resultsFile(resultsPath);
+    if (!resultsPath.isEmpty() && !resultsFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        out << resultsPath << ": " << resultsFile.errorString() << Qt::endl;
+        return 1;
+    }
+
+    // the deals are what run in parallel, so each deal's AI searches on the one thread
+    settings.deterministic = true;
+    settings.maxRearrangeDepth = depth;
+
+    QList<DealResult> results(deals);
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QElapsedTimer timer;
+    timer.start();
+    for (int deal = 0; deal < deals; deal++)
+    {
+        DealResult &result(results[deal]);
+        pool.start([deal, seed, players, &settings, &result]() { result = playDeal(deal, seed + quint32(deal), players, settings); });
+    }
+    pool.waitForDone();
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    long turns = 0;
+    qint64 aiTurnNs = 0, maxAiTurnNs = 0;
+    DealResult noPlayFilterTotal;
+    QList<int> wins(players + 1, 0);
+    for (const DealResult &result : results)
+    {
+        qint64 dealAiTurnNs = 0, dealMaxAiTurnNs = 0;
+        for (qint64 ns : result.aiTurnNs)
+        {
+            dealAiTurnNs += ns;
+            dealMaxAiTurnNs = qMax(dealMaxAiTurnNs, ns);
+        }
+        turns += result.turns;
+        aiTurnNs += dealAiTurnNs;
+        maxAiTurnNs = qMax(maxAiTurnNs, dealMaxAiTurnNs);
+        wins[result.winner + 1]++;
+        noPlayFilterTotal.noPlayFilterChecks += result.noPlayFilterChecks;
+        noPlayFilterTotal.noPlayFilterHits += result.noPlayFilterHits;
+        noPlayFilterTotal.noPlayFilterNs += result.noPlayFilterNs;
+        noPlayFilterTotal.noPlayFilterSavedNs += result.noPlayFilterSavedNs;
+        noPlayFilterTotal.noPlayFilterSavedNodes += result.noPlayFilterSavedNodes;
+
+        QStringList cardsLeft;
+        for (int count : result.cardsLeft)
+            cardsLeft.append(QString::number(count));
+        out << "deal " << result.deal << "  seed " << result.seed
+            << "  " << ((result.winner >= 0) ? QString("winner %1").arg(result.winner) : QString("no winner"))
+            << "  turns " << result.turns << "  cards left " << cardsLeft.join(",")
+            << "  AI ms/turn " << QString::number(dealAiTurnNs / 1e6 / qMax(1, result.turns), 'f', 3)
+            << " (max " << QString::number(dealMaxAiTurnNs / 1e6, 'f', 3) << ")" << Qt::endl;
+        if (resultsFile.isOpen())
+            resultsFile.write(QJsonDocument(resultToJson(result)).toJson(QJsonDocument::Compact) + '\n');
+    }
+
+    const double seconds = elapsedNs / 1e9;
+    out << "deals " << deals << "  players " << players << "  threads " << threads << "  depth " << depth << "  seed " << seed << Qt::endl;
+    out << "no winner " << wins.at(0);
+    for (int player = 0; player < players; player++)
+        out << "  player " << player << " won " << wins.at(player + 1);
+    out << Qt::endl;
+    out << "seconds " << QString::number(seconds, 'f', 3)
+        << "  deals/sec " << QString::number(deals / seconds, 'f', 2)
+        << "  turns/sec " << QString::number(turns / seconds, 'f', 1)
+        << "  AI ms/turn " << QString::number(aiTurnNs / 1e6 / qMax(1L, turns), 'f', 3)
+        << " (max " << QString::number(maxAiTurnNs / 1e6, 'f', 3) << ")" << Qt::endl;
+    out << "no-play filter: checks " << noPlayFilterTotal.noPlayFilterChecks << "  searches skipped " << noPlayFilterTotal.noPlayFilterHits
+        << "  filter ms " << QString::number(noPlayFilterTotal.noPlayFilterNs / 1e6, 'f', 3);
+    if (settings.measureNoPlayFilter)
+        out << "  skipped searches ms " << QString::number(noPlayFilterTotal.noPlayFilterSavedNs / 1e6, 'f', 3)
+            << " (states searched " << noPlayFilterTotal.noPlayFilterSavedNodes << ")";
+    out << Qt::endl;
+    return 0;
+}
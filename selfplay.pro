@@ -0,0 +1,12 @@
+# the `selfplay` command-line tool, which runs without a display (see CMakeLists.txt for how it is run)
+# (build it in a directory of its own, apart from the game's & the other tools', as each project writes its own Makefile)
+QT       += core
+QT       -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(engine.pri)
+
+SOURCES += \
+    selfplay.cpp
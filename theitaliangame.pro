@@ -2,36 +2,29 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++17
+CONFIG += c++17 warn_on
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# the engine's sources are in engine.pri, which the command-line tools' projects (aibenchmark.pro, selfplay.pro & aimicrobenchmark.pro) include too
+include(engine.pri)
+
 SOURCES += \
-    aimodel.cpp \
     baizescene.cpp \
     baizeview.cpp \
-    carddeck.cpp \
-    cardgroup.cpp \
-    cardhand.cpp \
-    logicalmodel.cpp \
     main.cpp \
     mainwindow.cpp \
-    card.cpp \
-    cardimages.cpp
+    cardimages.cpp \
+    selectcardmenu.cpp
 
 HEADERS += \
-    aimodel.h \
     baizescene.h \
     baizeview.h \
-    carddeck.h \
-    cardgroup.h \
-    cardhand.h \
-    logicalmodel.h \
     mainwindow.h \
-    card.h \
-    cardimages.h
+    cardimages.h \
+    selectcardmenu.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -2,8 +2,9 @@
 
 std::mt19937 &RandomNumber::random_generator()
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
+    // one generator per thread, so that searches running in parallel do not share one
+    static thread_local std::random_device rd;
+    static thread_local std::mt19937 gen(rd());
     return gen;
 }
 